@@ -34,7 +34,7 @@ static void SystemClock_Config(void);
 static int flash_kv_system_init(void)
 {
     int ret;
-    kv_instance_config_t config;
+    kv_instance_config_t config = {0};
 
     /* 注册STM32 Flash适配器 */
     ret = flash_kv_adapter_register(&stm32_flash_ops);
@@ -65,6 +65,21 @@ static int stm32_flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
     return 0;
 }
 
+/**
+ * @brief 映射Flash数据 (零拷贝读取)
+ * @param addr 绝对Flash地址
+ * @param len 长度
+ * @return 只读指针，片内Flash总是可以直接访问
+ */
+static const uint8_t *stm32_flash_map(uint32_t addr, uint32_t len)
+{
+    (void)len;
+    if (addr < FLASH_BASE_ADDR) {
+        addr = FLASH_BASE_ADDR + addr;
+    }
+    return (const uint8_t *)addr;
+}
+
 /**
  * @brief 写入Flash数据
  * @param addr 绝对Flash地址
@@ -216,4 +231,5 @@ const flash_kv_ops_t stm32_flash_ops = {
     .read   = stm32_flash_read,
     .write  = stm32_flash_write,
     .erase  = stm32_flash_erase,
+    .map    = stm32_flash_map,
 };
@@ -17,30 +17,120 @@ int flash_kv_adapter_register(const flash_kv_ops_t *ops);
 const flash_kv_ops_t* flash_kv_adapter_get(void);
 
 int flash_kv_init(uint8_t instance_id, const kv_instance_config_t *config);
+/* 按最多max_keys个key计算工作区各缓冲区大小 (ws可为NULL，可选缓冲区置为不使用)，返回总字节数 */
+uint32_t flash_kv_workspace_size(uint32_t max_keys, kv_workspace_t *ws);
 kv_handle_t* flash_kv_get_handle(uint8_t instance_id);
+/* key的32位哈希 (算法由FLASH_KV_HASH_METHOD选择，与平台无关)，用于_hashed接口 */
+uint32_t flash_kv_key_hash(const uint8_t *key, uint8_t key_len);
 int flash_kv_deinit(uint8_t instance_id);
 
+typedef int (*kv_foreach_cb)(const uint8_t *key, uint8_t key_len,
+                             const uint8_t *value, uint8_t value_len,
+                             void *user_data);
+
+/* 批量读写的条目：mget时value为至少FLASH_KV_VALUE_SIZE字节的输出缓冲，只复制实际长度的
+ * value (其余字节不清零)，value_len返回实际长度；mset时value为要写入的数据；
+ * result返回该条目的结果 */
+typedef struct {
+    const uint8_t *key;
+    uint8_t key_len;
+    uint8_t value_len;
+    uint8_t *value;
+    int result;
+} kv_item_t;
+
+/* 按句柄操作：每个实例有独立的索引、计数和事务状态，可分别GC。
+ * get的*value_len输入为value缓冲区大小，输出为实际值长度；缓冲区放不下时不复制，
+ * 返回KV_ERR_BUF_TOO_SMALL，*value_len返回需要的长度 */
+int flash_kv_set_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                   const uint8_t *value, uint8_t value_len);
+int flash_kv_get_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                   uint8_t *value, uint8_t *value_len);
+int flash_kv_del_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len);
+bool flash_kv_exists_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len);
+/* 使用预先算好的key哈希 (必须等于flash_kv_key_hash(key, key_len))，省去每次调用时计算 */
+int flash_kv_set_hashed_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                          uint32_t hash, const uint8_t *value, uint8_t value_len);
+int flash_kv_get_hashed_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                          uint32_t hash, uint8_t *value, uint8_t *value_len);
+int flash_kv_del_hashed_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                          uint32_t hash);
+/* 零拷贝读取 (需要ops->map)：ref指向映射Flash中已校验CRC的value，不复制；
+ * 记录所在扇区擦除后引用失效 (其他扇区的擦除不影响)，使用前用ref_valid检查，
+ * 失效时重新get_ref */
+int flash_kv_get_ref_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len, kv_ref_t *ref);
+bool flash_kv_ref_valid_h(kv_handle_t *handle, const kv_ref_t *ref);
+/* 批量读取：按Flash偏移排序后合并相邻记录的读取，返回找到的条目数，负值失败 */
+int flash_kv_mget_h(kv_handle_t *handle, kv_item_t *items, uint32_t count);
+/* 批量写入：相邻条目合并为一次编程，返回0或第一个失败条目的错误码 (之前的条目已写入) */
+int flash_kv_mset_h(kv_handle_t *handle, kv_item_t *items, uint32_t count);
+
+/* 写回模式 (config->write_back_delay非0)：set先缓冲在RAM中，值与已保存的相同时不写入；
+ * poll传入当前时间，写入缓冲超过延迟的值，返回仍在缓冲的key数；flush写入全部缓冲的值。
+ * 写入前掉电时缓冲中的值丢失 */
+int flash_kv_poll_h(kv_handle_t *handle, uint32_t now);
+int flash_kv_flush_h(kv_handle_t *handle);
+
+int flash_kv_tx_begin_h(kv_handle_t *handle);
+int flash_kv_tx_commit_h(kv_handle_t *handle);
+int flash_kv_tx_rollback_h(kv_handle_t *handle);
+
+int flash_kv_gc_h(kv_handle_t *handle);
+/* 增量GC：最多执行budget步，返回KV_GC_PENDING表示本轮未完成 */
+int flash_kv_gc_step_h(kv_handle_t *handle, uint32_t budget);
+/* 预擦除：最多擦除count个空闲扇区，还有余量时保存到期的索引快照；
+ * 返回仍待擦除的扇区数 (含待保存的快照)，负值失败 */
+int flash_kv_pre_erase_h(kv_handle_t *handle, uint32_t count);
+uint8_t flash_kv_free_percent_h(kv_handle_t *handle);
+int flash_kv_checkpoint_h(kv_handle_t *handle);
+int flash_kv_foreach_h(kv_handle_t *handle, kv_foreach_cb callback, void *user_data);
+int flash_kv_clear_h(kv_handle_t *handle);
+uint32_t flash_kv_count_h(kv_handle_t *handle);
+int flash_kv_status_h(kv_handle_t *handle, uint32_t *total, uint32_t *used);
+/* 值缓存自初始化以来的命中/未命中次数 (未配置缓存时都为0) */
+int flash_kv_cache_stats_h(kv_handle_t *handle, uint32_t *hits, uint32_t *misses);
+/* 索引探测长度：entries为索引条目数，max_probe/total_probe为命中查找检查槽数的最大值/总和 */
+int flash_kv_index_stats_h(kv_handle_t *handle, uint32_t *entries, uint32_t *max_probe,
+                           uint32_t *total_probe);
+
+/* 以下接口操作实例0，参数含义与对应的_h接口相同 */
 int flash_kv_set(const uint8_t *key, uint8_t key_len,
                  const uint8_t *value, uint8_t value_len);
 int flash_kv_get(const uint8_t *key, uint8_t key_len,
                  uint8_t *value, uint8_t *value_len);
 int flash_kv_del(const uint8_t *key, uint8_t key_len);
 bool flash_kv_exists(const uint8_t *key, uint8_t key_len);
+int flash_kv_set_hashed(const uint8_t *key, uint8_t key_len, uint32_t hash,
+                        const uint8_t *value, uint8_t value_len);
+int flash_kv_get_hashed(const uint8_t *key, uint8_t key_len, uint32_t hash,
+                        uint8_t *value, uint8_t *value_len);
+int flash_kv_del_hashed(const uint8_t *key, uint8_t key_len, uint32_t hash);
+int flash_kv_get_ref(const uint8_t *key, uint8_t key_len, kv_ref_t *ref);
+bool flash_kv_ref_valid(const kv_ref_t *ref);
+int flash_kv_mget(kv_item_t *items, uint32_t count);
+int flash_kv_mset(kv_item_t *items, uint32_t count);
+
+int flash_kv_poll(uint32_t now);
+int flash_kv_flush(void);
 
 int flash_kv_tx_begin(void);
 int flash_kv_tx_commit(void);
 int flash_kv_tx_rollback(void);
 
 int flash_kv_gc(void);
+int flash_kv_gc_step(uint32_t budget);
+int flash_kv_pre_erase(uint32_t count);
 uint8_t flash_kv_free_percent(void);
 
-typedef int (*kv_foreach_cb)(const uint8_t *key, uint8_t key_len,
-                             const uint8_t *value, uint8_t value_len,
-                             void *user_data);
+/* 立即保存索引快照 (需配置快照区)，例如关机前调用 */
+int flash_kv_checkpoint(void);
+
 int flash_kv_foreach(kv_foreach_cb callback, void *user_data);
 
 int flash_kv_clear(void);
 uint32_t flash_kv_count(void);
 int flash_kv_status(uint32_t *total, uint32_t *used);
+int flash_kv_cache_stats(uint32_t *hits, uint32_t *misses);
+int flash_kv_index_stats(uint32_t *entries, uint32_t *max_probe, uint32_t *total_probe);
 
 #endif
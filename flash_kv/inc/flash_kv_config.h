@@ -27,14 +27,17 @@
  * KV 存储配置
  *============================================================================*/
 
-/* Key 长度 (字节) */
+/* Key 最大长度 (字节) */
 #define FLASH_KV_KEY_SIZE          32
 
-/* Value 长度 (字节) */
+/* Value 最大长度 (字节) */
 #define FLASH_KV_VALUE_SIZE        64
 
-/* 每条记录总大小 = Key + Value + Meta(4) + CRC16(2) */
-#define FLASH_KV_RECORD_SIZE       (FLASH_KV_KEY_SIZE + FLASH_KV_VALUE_SIZE + 4 + 2)
+/* 单条记录最大长度 = 头部(12) + Key + Value，按写入单位对齐；
+ * 记录按实际key/value长度存储，不再填充到最大长度 */
+#define FLASH_KV_RECORD_SIZE       ((12 + FLASH_KV_KEY_SIZE + FLASH_KV_VALUE_SIZE + \
+                                     FLASH_KV_WRITE_SIZE - 1) / FLASH_KV_WRITE_SIZE * \
+                                    FLASH_KV_WRITE_SIZE)
 
 /* 最大记录条数 */
 #define FLASH_KV_MAX_RECORDS       512
@@ -53,16 +56,119 @@
  * GC 配置
  *============================================================================*/
 
-/* GC 触发阈值：空闲空间小于此值时触发 (百分比 0-100) */
+/* 每个实例最多的扇区数 (数据区大小 / 块大小)，决定句柄中扇区表的大小 */
+#ifndef FLASH_KV_SECTOR_MAX
+#define FLASH_KV_SECTOR_MAX       64
+#endif
+
+/* GC 触发阈值：空闲空间小于此值时开始回收最旧的扇区 (百分比 0-100) */
 #define FLASH_KV_GC_THRESHOLD     20
 
+/* GC进行中每次写入顺带执行的最少增量GC步数 (一次块擦除或一条记录的搬移计一步)；
+ * 步数按剩余工作量自动增加，保证留给GC的空闲扇区之外的空间用完前完成回收 */
+#ifndef FLASH_KV_GC_STEP_BUDGET
+#define FLASH_KV_GC_STEP_BUDGET   8
+#endif
+
+/* 擦除前先读出扇区检查是否已是擦除态 (全0xFF)，是则跳过擦除，减少擦除耗时和磨损。
+ * 擦除中途掉电的扇区可能读出全0xFF但未擦除彻底，要求每次都完整擦除时设为0 */
+#ifndef FLASH_KV_BLANK_CHECK
+#define FLASH_KV_BLANK_CHECK      1
+#endif
+
+/*============================================================================
+ * 索引快照配置
+ *============================================================================*/
+
+/* 每写入多少条记录索引快照到期，到期的快照由flash_kv_pre_erase()在空闲时保存，
+ * 写入路径不擦除也不写快照 (flash_kv_gc()后总会保存)，启动时只需回放快照之后的记录 */
+#ifndef FLASH_KV_CHECKPOINT_INTERVAL
+#define FLASH_KV_CHECKPOINT_INTERVAL  64
+#endif
+
 /*============================================================================
  * 哈希表配置
  *============================================================================*/
 
-/* 哈希表大小 (必须是2的幂) */
+/* 内置静态工作区的哈希表大小 (必须是2的幂，最多保存槽数的7/8个key)；
+ * 调用者提供工作区时由索引缓冲区大小决定 */
 #define FLASH_KV_HASH_SIZE        1024
 
+/* key哈希算法：
+ * 0 - DJB2，逐字节计算，共同前缀长的key容易聚集 (与旧版本写入的指纹快照兼容)
+ * 1 - wyhash类，每次乘法混合8字节，分布均匀 (默认) */
+#define KV_HASH_METHOD_DJB2        0
+#define KV_HASH_METHOD_WY32        1
+
+#ifndef FLASH_KV_HASH_METHOD
+#define FLASH_KV_HASH_METHOD       KV_HASH_METHOD_WY32
+#endif
+
+/* 索引查找时控制标签的分组匹配方式：1 - SSE2指令 (x86主机)，
+ * 0 - SWAR (32位整数运算，适用于Cortex-M等任意平台)；默认按编译目标选择 */
+#ifndef FLASH_KV_INDEX_SSE2
+#if defined(__SSE2__)
+#define FLASH_KV_INDEX_SSE2       1
+#else
+#define FLASH_KV_INDEX_SSE2       0
+#endif
+#endif
+
+/* 为每个实例静态分配内置工作区 (索引 + I/O缓冲)，config->workspace为NULL时使用；
+ * 设为0时所有实例都必须提供工作区，不占用静态RAM */
+#ifndef FLASH_KV_STATIC_WORKSPACE
+#define FLASH_KV_STATIC_WORKSPACE 1
+#endif
+
+/* 内置静态工作区中每个实例的I/O缓冲字节数 (不足一条最大记录时按一条记录)，也是批量读写
+ * 合并成一次读取或编程的最大字节数；调用者提供工作区时由io_size决定 */
+#ifndef FLASH_KV_IO_BUF_SIZE
+#define FLASH_KV_IO_BUF_SIZE      512
+#endif
+
+/* 内置静态工作区中每个实例的值缓存条目数 (每条目约FLASH_KV_VALUE_SIZE + 8字节)，
+ * 0表示不缓存；调用者提供工作区时由cache_buf/cache_size决定 */
+#ifndef FLASH_KV_CACHE_ENTRIES
+#define FLASH_KV_CACHE_ENTRIES    0
+#endif
+
+/* 内置静态工作区中每个实例的写回缓冲条目数 (每条目约KEY + VALUE + 8字节)，即写回模式下
+ * 最多同时缓冲的key数，缓冲满时先写入全部已缓冲的值；0表示内置工作区不支持写回 */
+#ifndef FLASH_KV_DIRTY_ENTRIES
+#define FLASH_KV_DIRTY_ENTRIES    0
+#endif
+
+/* 内置静态工作区中每个实例的事务暂存区字节数，决定一个事务最多暂存多少条记录；
+ * 一个事务还受扇区载荷限制 (整批写入同一扇区) */
+#ifndef FLASH_KV_TX_BUF_SIZE
+#define FLASH_KV_TX_BUF_SIZE      1024
+#endif
+
+/* 索引模式：
+ * 0 - 槽内保存完整key (每槽约44字节)
+ * 1 - 槽内仅保存32位哈希指纹，指纹命中后读取Flash记录比对完整key (每槽8字节) */
+#ifndef FLASH_KV_INDEX_FINGERPRINT
+#define FLASH_KV_INDEX_FINGERPRINT 0
+#endif
+
+/*============================================================================
+ * CRC配置
+ *============================================================================*/
+
+#define KV_CRC_METHOD_BITWISE      0   /* 逐位计算，无查找表 */
+#define KV_CRC_METHOD_TABLE        1   /* 256项查找表 (CRC16 512B + CRC32 1KB ROM) */
+#define KV_CRC_METHOD_SLICE8       2   /* slicing-by-8 (CRC16 4KB + CRC32 8KB ROM) */
+
+#ifndef FLASH_KV_CRC_METHOD
+#define FLASH_KV_CRC_METHOD        KV_CRC_METHOD_TABLE
+#endif
+
+/* CRC-32改用CRC32C (x86 SSE4.2主机构建使用硬件指令)。
+ * 与默认CRC-32不兼容，只适用于由主机独占读写的存储 */
+#ifndef FLASH_KV_CRC32_CASTAGNOLI
+#define FLASH_KV_CRC32_CASTAGNOLI  0
+#endif
+
 /*============================================================================
  * 线程安全配置
  *============================================================================*/
@@ -10,6 +10,7 @@
 #ifndef FLASH_KV_TYPES_H
 #define FLASH_KV_TYPES_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "flash_kv_config.h"
@@ -28,7 +29,9 @@ typedef enum {
     KV_ERR_NO_INIT = -7,
     KV_ERR_GC_FAIL = -8,
     KV_ERR_INVALID_REGION = -9,
-    KV_ERR_HASH_FULL = -10
+    KV_ERR_HASH_FULL = -10,
+    KV_ERR_BUF_TOO_SMALL = -11, /* 读取缓冲区小于value，*value_len返回实际长度 */
+    KV_GC_PENDING = 1           /* 非错误：增量GC本轮尚未完成 */
 } kv_err_t;
 
 /*============================================================================
@@ -39,8 +42,19 @@ typedef struct {
     int (*read)(uint32_t addr, uint8_t *buf, uint32_t len);
     int (*write)(uint32_t addr, const uint8_t *buf, uint32_t len);
     int (*erase)(uint32_t addr, uint32_t len);
+    /* 可选：内存映射的Flash返回addr处len字节的只读指针，失败返回NULL；为NULL时不支持零拷贝读取 */
+    const uint8_t *(*map)(uint32_t addr, uint32_t len);
 } flash_kv_ops_t;
 
+/*============================================================================
+ * 内存分配器 (可选，用于可扩容的索引)
+ *============================================================================*/
+typedef struct {
+    void *(*alloc)(void *ctx, uint32_t size);   /* 返回4字节对齐的内存，失败返回NULL */
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+} kv_allocator_t;
+
 /*============================================================================
  * KV 实例配置
  *============================================================================*/
@@ -49,13 +63,22 @@ typedef struct {
     uint32_t total_size;
     uint32_t block_size;
     const flash_kv_ops_t *ops;
+    uint32_t checkpoint_addr;   /* 索引快照区起始地址 (块对齐，不能与数据区重叠) */
+    uint32_t checkpoint_size;   /* 索引快照区大小，至少2个块，0表示不使用快照 */
+    const struct kv_workspace *workspace;  /* 调用者提供的RAM，NULL时使用内置静态工作区 */
+    uint32_t write_back_delay;  /* 写回延迟 (时间单位同flash_kv_poll的now)，0表示set直接写入 */
+    /* 索引分配器，非NULL时索引从它分配 (不使用工作区的index_buf)，接近满载时增量扩容；
+     * 须在实例卸载前保持有效 */
+    const kv_allocator_t *allocator;
+    uint32_t index_keys;        /* 使用分配器时初始索引按多少个key分配，0为最小 */
 } kv_instance_config_t;
 
 /*============================================================================
  * 魔术字定义
  *============================================================================*/
-#define KV_MAGIC              0x4B565341
-#define KV_MAGIC_B            0x4B565342
+#define KV_SECTOR_MAGIC       0x4B53
+/* 快照中的指纹依赖哈希算法，不同算法写入的快照互不识别 (启动时退回扫描日志) */
+#define KV_CHECKPOINT_MAGIC   (0x4B56434Bu ^ ((uint32_t)FLASH_KV_HASH_METHOD << 8))
 
 /*============================================================================
  * 事务状态 (持久化到Flash)
@@ -67,58 +90,248 @@ typedef enum {
 } kv_tx_state_persist_t;
 
 /*============================================================================
- * KV 句柄
+ * 记录结构 (变长：头部 + key + value，总长按FLASH_KV_WRITE_SIZE对齐，填充0xFF)
  *============================================================================*/
-typedef struct kv_handle {
-    uint8_t instance_id;
-    uint32_t active_region;
-    uint32_t version;
-    uint32_t record_count;
-    kv_tx_state_persist_t tx_state;
-    uint32_t region_addr[2];
-    uint32_t region_size;
-    uint32_t block_size;
-    const flash_kv_ops_t *ops;
-} kv_handle_t;
+#define KV_RECORD_MAGIC         0x4B52
+
+/* flags各位低有效 (清零表示置位)，未使用的位保持1 */
+#define KV_RECORD_FLAG_TOMBSTONE  0x01  /* 删除标记，无value */
+#define KV_RECORD_FLAG_BATCH      0x02  /* 批量写入的记录，其后有提交标记时才生效 */
+#define KV_RECORD_FLAG_COMMIT     0x04  /* 批量提交标记：无key，value为本批记录的总字节数 */
+
+typedef struct {
+    uint16_t magic;      /* KV_RECORD_MAGIC，擦除态表示日志末尾 */
+    uint8_t  flags;      /* KV_RECORD_FLAG_* */
+    uint8_t  reserved;
+    uint8_t  key_len;    /* 实际key长度 */
+    uint8_t  value_len;  /* 实际value长度 */
+    uint16_t crc16;      /* 覆盖除crc16外的头部字段及key、value */
+    uint32_t seq;        /* 写入序号，递增；GC搬移时保留原序号 */
+} __attribute__((packed)) kv_record_header_t;
+
+/* 记录在Flash中的实际长度 */
+#define KV_RECORD_SIZE(key_len, value_len) \
+    ((sizeof(kv_record_header_t) + (key_len) + (value_len) + FLASH_KV_WRITE_SIZE - 1) / \
+     FLASH_KV_WRITE_SIZE * FLASH_KV_WRITE_SIZE)
+
+/* 读写缓冲：data中依次为key、value和对齐填充 */
+typedef struct {
+    kv_record_header_t header;
+    uint8_t data[FLASH_KV_KEY_SIZE + FLASH_KV_VALUE_SIZE + FLASH_KV_WRITE_SIZE];
+} __attribute__((packed)) kv_record_t;
+
+/* 只读取头部和key时使用 */
+typedef struct {
+    kv_record_header_t header;
+    uint8_t key[FLASH_KV_KEY_SIZE];
+} __attribute__((packed)) kv_record_key_t;
 
 /*============================================================================
- * 记录结构
+ * 工作区 (调用者提供的RAM，可放在TCM/CCM等零等待RAM中)
  *============================================================================*/
+
+/* I/O缓冲区最小长度：一条最大记录 */
+#define KV_IO_BUF_SIZE  sizeof(kv_record_t)
+
+/* 值缓存条目：按记录在数据区内的偏移缓存其value (同一偏移的记录在扇区回收前不变) */
+typedef struct {
+    uint32_t offset;        /* 记录偏移，0表示空条目 */
+    uint8_t value_len;
+    uint8_t referenced;     /* CLOCK置换的访问位 */
+    uint8_t hand;           /* 组内CLOCK指针，只使用每组第一个条目的 */
+    uint8_t value[FLASH_KV_VALUE_SIZE];
+} kv_cache_entry_t;
+
+/* 写回缓冲条目：尚未写入Flash的最新值 */
 typedef struct {
+    uint8_t key_len;        /* 0表示空条目 */
+    uint8_t value_len;
     uint8_t key[FLASH_KV_KEY_SIZE];
     uint8_t value[FLASH_KV_VALUE_SIZE];
-    uint8_t key_len;     /* 实际key长度 */
-    uint8_t value_len;   /* 实际value长度 */
-    uint8_t flags;       /* bit0: valid, bit1: deleted */
-    uint8_t reserved[1];
-    uint16_t crc16;
-} __attribute__((packed)) kv_record_t;
+    uint32_t since;         /* 开始缓冲的时间，到期后写入 */
+} kv_dirty_entry_t;
+
+/* 零拷贝读取的value引用：指向映射Flash中已校验CRC的value，所在扇区擦除后失效 */
+typedef struct {
+    const uint8_t *value;
+    uint8_t value_len;
+    uint32_t sector;        /* 记录所在扇区 */
+    uint32_t generation;    /* 取得引用时该扇区的擦除代数 */
+} kv_ref_t;
+
+typedef struct kv_workspace {
+    void *index_buf;        /* 索引槽数组，4字节对齐 */
+    uint32_t index_size;    /* 字节数，按不超过它的最大2的幂个槽使用 */
+    void *io_buf;           /* 记录读写和快照分块缓冲，4字节对齐 */
+    uint32_t io_size;       /* 字节数，至少KV_IO_BUF_SIZE */
+    void *cache_buf;        /* 可选，值缓存 (每条目sizeof(kv_cache_entry_t)字节)，4字节对齐，NULL表示不使用；
+                             * 超过4个条目时按4路组相联使用不超过的最大2的幂个组 */
+    uint32_t cache_size;
+    void *tx_buf;           /* 可选，事务暂存的批量记录，4字节对齐，NULL表示不支持事务内写入 */
+    uint32_t tx_size;
+    void *dirty_buf;        /* 可选，写回缓冲 (kv_dirty_entry_t数组)，4字节对齐，启用写回时必需 */
+    uint32_t dirty_size;
+} kv_workspace_t;
 
 /*============================================================================
- * 区域头部
+ * 扇区头部 (数据区按擦除块划分为扇区，组成环形日志)
+ *============================================================================*/
+/* flags各位低有效 (清零表示置位)，未使用的位保持1 */
+#define KV_SECTOR_FLAG_COLD     0x01    /* 冷数据流：GC搬移的记录和删除标记 */
+
+typedef struct {
+    uint16_t magic;             /* KV_SECTOR_MAGIC，擦除态表示空闲扇区 */
+    uint8_t  flags;             /* KV_SECTOR_FLAG_* */
+    uint8_t  reserved;          /* 保持0xFF */
+    uint32_t seq;               /* 扇区打开顺序，递增，决定流内的回放顺序 */
+    uint32_t record_seq;        /* 打开时的下一个记录序号，之前写入的记录序号都小于它 */
+    uint32_t crc32;             /* 覆盖以上字段 */
+    uint8_t  retired[FLASH_KV_WRITE_SIZE];  /* 打开时不编程；GC回收后写0，未擦除前重启时视为空闲 */
+} __attribute__((packed)) kv_sector_header_t;
+
+/* 回收标记要能单独编程：其前的字段须恰好占满整数个写入单位，头部之后的记录也按写入单位对齐 */
+_Static_assert(offsetof(kv_sector_header_t, retired) % FLASH_KV_WRITE_SIZE == 0,
+               "sector header fields must fill whole FLASH_KV_WRITE_SIZE units");
+_Static_assert(sizeof(kv_sector_header_t) % FLASH_KV_WRITE_SIZE == 0,
+               "sector header size must be a multiple of FLASH_KV_WRITE_SIZE");
+
+/* 扇区状态 (内存中) */
+#define KV_SECTOR_FREE          0xFFFFFFFF  /* seq取此值表示空闲扇区 */
+#define KV_SECTOR_NONE          0xFFFFFFFF  /* cold_sector取此值表示还没有冷数据流 */
+
+typedef struct {
+    uint32_t seq;               /* 扇区序号，KV_SECTOR_FREE表示空闲 */
+    uint32_t live;              /* 扇区内索引指向的记录占用字节，其余已写空间可回收 */
+    uint32_t record_seq;        /* 同头部record_seq */
+    uint8_t  erased;            /* 1: 已确认为擦除态，打开时无需再擦除 */
+    uint8_t  cold;              /* 1: 属于冷数据流 */
+    uint8_t  reserved[2];
+    uint32_t erase_gen;         /* 扇区擦除代数，每次擦除加1，指向扇区内的引用随之失效 */
+} kv_sector_t;
+
+/*============================================================================
+ * 索引快照 (写入快照区的一个半区：头部 + entry_count个条目 + sector_count个
+ * 扇区有效字节数)
  *============================================================================*/
 typedef struct {
     uint32_t magic;
-    uint32_t version;
-    uint32_t record_count;
-    uint32_t active_offset;
-    uint8_t  tx_state;
-    uint8_t  reserved[3];
-    uint32_t crc32;
-} __attribute__((packed)) kv_region_header_t;
+    uint32_t seq;               /* 快照序号，两个半区取较大者 */
+    uint32_t head_seq;          /* 快照时热数据头扇区的序号，该扇区被回收后快照失效 */
+    uint32_t write_offset;      /* 快照时的追加位置，启动时从此处回放 */
+    uint32_t cold_seq;          /* 快照时冷数据头扇区的序号，没有冷数据流时为KV_SECTOR_FREE */
+    uint32_t cold_offset;       /* 快照时冷数据流的追加位置 */
+    uint32_t next_seq;          /* 快照时的下一个写入序号 */
+    uint32_t entry_count;
+    uint32_t sector_count;      /* 其后扇区有效字节表的项数，须与当前分区一致 */
+    uint32_t crc32;             /* 覆盖以上字段、全部条目和扇区有效字节表 */
+} __attribute__((packed)) kv_checkpoint_header_t;
+
+typedef struct {
+    uint32_t fingerprint;
+    uint32_t flash_offset;
+} kv_checkpoint_entry_t;
 
 /*============================================================================
  * 哈希表槽
  *============================================================================*/
+#if FLASH_KV_INDEX_FINGERPRINT
+typedef struct {
+    uint32_t fingerprint;   /* key的32位哈希 */
+    uint32_t flash_offset;  /* 0表示空槽 (偏移0处是扇区头部，不会是记录) */
+} kv_hash_slot_t;
+#else
 typedef struct {
     uint8_t  key_len;
     uint8_t  key[FLASH_KV_KEY_SIZE];
+    uint32_t hash;          /* key的32位哈希，探测距离和扩容搬移不必重新计算 */
     uint32_t flash_offset;
 } kv_hash_slot_t;
+#endif
 
-typedef struct {
-    kv_hash_slot_t slots[FLASH_KV_HASH_SIZE];
-    uint16_t count;
+/* 指纹模式下比对完整key：offset处记录的key与给定key相同时返回true */
+typedef bool (*kv_hash_match_fn)(void *ctx, uint32_t offset,
+                                 const uint8_t *key, uint8_t key_len);
+
+/* 索引控制字节分组宽度：查找时一次匹配一组 */
+#define KV_HASH_GROUP   16
+
+/* n个槽的索引缓冲区字节数：槽数组之后是每槽1字节的控制标签，
+ * 末尾再复制前GROUP-1个标签，从任意槽开始都能连续读取一组 */
+#define KV_INDEX_BUF_SIZE(n) \
+    ((((n) * (sizeof(kv_hash_slot_t) + 1) + KV_HASH_GROUP - 1) + 3) & ~(uint32_t)3)
+
+typedef struct kv_hash_table {
+    kv_hash_slot_t *slots;      /* 槽数组，位于工作区的索引缓冲区或由分配器分配 */
+    uint8_t *ctrl;              /* 控制标签，紧随槽数组：0x80空槽，否则为哈希高7位 */
+    uint32_t size;              /* 槽数，2的幂 */
+    uint32_t count;             /* 条目数 (扩容中包括旧表里尚未搬移的条目) */
+    uint32_t max_dist;          /* 条目离探测起点的最大距离 (查找上界，清空时复位) */
+#if FLASH_KV_INDEX_FINGERPRINT
+    kv_hash_match_fn match;
+    void *match_ctx;
+#endif
+    const kv_allocator_t *allocator;  /* NULL表示固定大小 */
+    struct kv_hash_table *old;  /* 增量扩容中的旧表，条目逐步搬到本表，NULL表示未在扩容 */
+    uint32_t migrate_pos;       /* 旧表中下一个待搬移的槽 */
 } kv_hash_table_t;
 
+/*============================================================================
+ * 增量GC阶段
+ *============================================================================*/
+typedef enum {
+    KV_GC_IDLE = 0,
+    KV_GC_COPY = 1,             /* 逐条把回收扇区的有效记录搬移到冷数据流 */
+    KV_GC_RETIRE = 2            /* 回收扇区放回空闲扇区，擦除由预擦除或打开时完成 */
+} kv_gc_state_t;
+
+/*============================================================================
+ * KV 句柄
+ *============================================================================*/
+typedef struct kv_handle {
+    uint8_t instance_id;
+    kv_hash_table_t index;      /* 本实例的索引 */
+    uint8_t *io_buf;            /* 工作区I/O缓冲 */
+    uint32_t io_size;
+    kv_cache_entry_t *cache;    /* 工作区值缓存 (可选)，cache_entries为0表示不使用 */
+    uint32_t cache_entries;     /* 实际使用的条目数 (组数 x 每组条目数) */
+    uint32_t cache_sets;        /* 组数，2的幂，按记录偏移的哈希选组 */
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    uint32_t record_count;
+    kv_tx_state_persist_t tx_state;
+    uint8_t *tx_buf;            /* 事务暂存区：待提交的记录依次排列，末尾留出提交标记 */
+    uint32_t tx_size;
+    uint32_t tx_used;           /* 已暂存的记录字节数 */
+    kv_dirty_entry_t *dirty;    /* 写回缓冲 (可选) */
+    uint32_t dirty_entries;
+    uint32_t dirty_count;       /* 已用条目数 */
+    uint32_t wb_delay;          /* 写回延迟，0表示不启用写回 */
+    uint32_t wb_now;            /* 最近一次flash_kv_poll传入的时间 */
+    uint32_t base_addr;         /* 数据区起始地址 */
+    uint32_t total_size;
+    uint32_t block_size;        /* 扇区大小 (擦除块) */
+    uint32_t sector_count;
+    kv_sector_t sectors[FLASH_KV_SECTOR_MAX];
+    uint32_t head_sector;       /* 当前追加的扇区 (热数据流：用户写入) */
+    uint32_t cold_sector;       /* 冷数据流的追加扇区，KV_SECTOR_NONE表示还没有 */
+    uint32_t sector_seq;        /* 最新打开的扇区序号 */
+    uint32_t free_sectors;      /* 空闲扇区数，最后一个留给GC搬移 */
+    const flash_kv_ops_t *ops;
+    uint32_t write_offset;      /* 追加写入位置 (数据区内偏移) */
+    uint32_t cold_offset;       /* 冷数据流追加位置 */
+    uint32_t next_seq;          /* 下一条记录的写入序号 */
+    uint32_t live_bytes;        /* 索引指向的记录占用字节 */
+    uint32_t dead_bytes;        /* 旧版本、删除标记和损坏记录占用字节，GC可回收 */
+    kv_gc_state_t gc_state;     /* 增量GC阶段 */
+    uint32_t gc_victim;         /* 正在回收的扇区 */
+    uint32_t gc_scan_offset;    /* 回收扇区中下一条待扫描记录 */
+    uint32_t gc_reclaimed;      /* 已回收的扇区数 */
+    uint32_t gc_moved;          /* GC搬移的字节数 (写放大 = (写入 + 搬移) / 写入) */
+    uint32_t ckpt_addr;         /* 索引快照区，ckpt_size为0表示未启用 */
+    uint32_t ckpt_size;
+    uint32_t ckpt_seq;          /* 最新快照序号 */
+    uint8_t  ckpt_slot;         /* 最新快照所在半区 */
+    uint32_t ckpt_writes;       /* 自最新快照以来写入的记录数 */
+} kv_handle_t;
+
 #endif /* FLASH_KV_TYPES_H */
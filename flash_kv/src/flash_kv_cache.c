@@ -0,0 +1,153 @@
+/**
+ * @file flash_kv_cache.c
+ * @brief 值缓存实现
+ * @description 在工作区的缓存缓冲中保存热点key的value，命中时不访问Flash。
+ *             条目按记录偏移标识：记录写入后在所在扇区回收前不会改变，
+ *             因此只需在记录被取代/删除、GC搬移和扇区回收时维护条目。
+ *             条目按4路组相联组织，偏移的哈希选组，查找和置换只检查一组；
+ *             组满时按CLOCK算法置换组内最近未访问的条目，每组有自己的指针。
+ * @author EasyData
+ * @date 2026-02-25
+ * @version 1.0.0
+ */
+
+#include <string.h>
+#include "flash_kv_cache.h"
+
+/* 每组条目数：get的查找代价固定，与缓存大小无关 */
+#define KV_CACHE_WAYS   4
+
+void kv_cache_attach(kv_handle_t *handle, void *buf, uint32_t size)
+{
+    uint32_t entries = (buf != NULL) ? size / sizeof(kv_cache_entry_t) : 0;
+
+    /* 组数取2的幂，多出的条目不使用；不超过一组时全部条目为一组 */
+    handle->cache_sets = 1;
+    if (entries > KV_CACHE_WAYS) {
+        while (handle->cache_sets * 2 * KV_CACHE_WAYS <= entries) {
+            handle->cache_sets *= 2;
+        }
+        entries = handle->cache_sets * KV_CACHE_WAYS;
+    }
+    handle->cache = (kv_cache_entry_t *)buf;
+    handle->cache_entries = entries;
+    handle->cache_hits = 0;
+    handle->cache_misses = 0;
+    kv_cache_clear(handle);
+}
+
+void kv_cache_clear(kv_handle_t *handle)
+{
+    for (uint32_t i = 0; i < handle->cache_entries; i++) {
+        handle->cache[i].offset = 0;
+        handle->cache[i].referenced = 0;
+        handle->cache[i].hand = 0;
+    }
+}
+
+/* 每组条目数 */
+static uint32_t kv_cache_ways(const kv_handle_t *handle)
+{
+    return (handle->cache_entries < KV_CACHE_WAYS) ? handle->cache_entries : KV_CACHE_WAYS;
+}
+
+/* offset所在组的第一个条目：乘法哈希打散同一扇区内相邻的偏移 */
+static kv_cache_entry_t *kv_cache_set(kv_handle_t *handle, uint32_t offset)
+{
+    uint32_t set = ((offset * 2654435761u) >> 16) & (handle->cache_sets - 1);
+    return &handle->cache[set * kv_cache_ways(handle)];
+}
+
+/* 在offset所在的组中查找条目，没有返回NULL */
+static kv_cache_entry_t *kv_cache_find(kv_handle_t *handle, uint32_t offset)
+{
+    kv_cache_entry_t *set = kv_cache_set(handle, offset);
+    uint32_t ways = kv_cache_ways(handle);
+
+    for (uint32_t i = 0; i < ways; i++) {
+        if (set[i].offset == offset) {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+const uint8_t *kv_cache_get(kv_handle_t *handle, uint32_t offset, uint8_t *value_len)
+{
+    if (handle->cache_entries == 0) {
+        return NULL;
+    }
+
+    kv_cache_entry_t *entry = kv_cache_find(handle, offset);
+    if (entry == NULL) {
+        handle->cache_misses++;
+        return NULL;
+    }
+    entry->referenced = 1;
+    *value_len = entry->value_len;
+    handle->cache_hits++;
+    return entry->value;
+}
+
+void kv_cache_put(kv_handle_t *handle, uint32_t offset, const uint8_t *value, uint8_t value_len)
+{
+    if (handle->cache_entries == 0) {
+        return;
+    }
+
+    /* 组内有空条目时直接使用，否则CLOCK：从本组的指针 (存放在组的第一个条目中) 开始，
+     * 跳过访问位为1的条目并清除其访问位 */
+    kv_cache_entry_t *set = kv_cache_set(handle, offset);
+    uint32_t ways = kv_cache_ways(handle);
+    kv_cache_entry_t *entry = NULL;
+    for (uint32_t i = 0; i < ways && entry == NULL; i++) {
+        if (set[i].offset == 0) {
+            entry = &set[i];
+        }
+    }
+    while (entry == NULL) {
+        kv_cache_entry_t *candidate = &set[set->hand];
+        set->hand = (uint8_t)((set->hand + 1) % ways);
+        if (!candidate->referenced) {
+            entry = candidate;
+        } else {
+            candidate->referenced = 0;
+        }
+    }
+
+    entry->offset = offset;
+    entry->referenced = 1;
+    entry->value_len = value_len;
+    memcpy(entry->value, value, value_len);
+}
+
+void kv_cache_move(kv_handle_t *handle, uint32_t old_offset, uint32_t new_offset)
+{
+    if (handle->cache_entries == 0 || old_offset == 0) {
+        return;
+    }
+
+    /* 新偏移可能属于另一组：从原组取出，放入新偏移所在的组 */
+    kv_cache_entry_t *entry = kv_cache_find(handle, old_offset);
+    if (entry != NULL) {
+        uint8_t value[FLASH_KV_VALUE_SIZE];
+        uint8_t value_len = entry->value_len;
+        memcpy(value, entry->value, value_len);
+        entry->offset = 0;
+        entry->referenced = 0;
+        if (new_offset != 0) {
+            kv_cache_put(handle, new_offset, value, value_len);
+        }
+    }
+}
+
+void kv_cache_drop_range(kv_handle_t *handle, uint32_t lo, uint32_t hi)
+{
+    for (uint32_t i = 0; i < handle->cache_entries; i++) {
+        kv_cache_entry_t *entry = &handle->cache[i];
+        if (entry->offset >= lo && entry->offset < hi) {
+            entry->offset = 0;
+            entry->referenced = 0;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/**
+ * @file flash_kv_cache.h
+ * @brief 值缓存接口头文件
+ * @description 热点key的value缓存接口声明
+ * @author EasyData
+ * @date 2026-02-25
+ * @version 1.0.0
+ */
+
+#ifndef FLASH_KV_CACHE_H
+#define FLASH_KV_CACHE_H
+
+#include "flash_kv_types.h"
+
+/* 绑定缓存缓冲区 (可为NULL)，按条目大小划分并清空 */
+void kv_cache_attach(kv_handle_t *handle, void *buf, uint32_t size);
+
+/* 清空所有条目 */
+void kv_cache_clear(kv_handle_t *handle);
+
+/* 查找offset处记录的value，命中返回缓存中的value并在value_len返回长度，未命中返回NULL；
+ * 统计命中/未命中次数 */
+const uint8_t *kv_cache_get(kv_handle_t *handle, uint32_t offset, uint8_t *value_len);
+
+/* 从Flash读出并校验后放入缓存，缓存满时按CLOCK置换 */
+void kv_cache_put(kv_handle_t *handle, uint32_t offset, const uint8_t *value, uint8_t value_len);
+
+/* 记录被取代、删除或GC搬移时更新对应条目 (new_offset为0表示丢弃) */
+void kv_cache_move(kv_handle_t *handle, uint32_t old_offset, uint32_t new_offset);
+
+/* 丢弃偏移落在[lo, hi)内的条目 (扇区回收后偏移将被新记录重用) */
+void kv_cache_drop_range(kv_handle_t *handle, uint32_t lo, uint32_t hi);
+
+#endif
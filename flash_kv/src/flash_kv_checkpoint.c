@@ -0,0 +1,334 @@
+/**
+ * @file flash_kv_checkpoint.c
+ * @brief 索引快照实现
+ * @description 把内存索引(指纹+偏移)保存到独立的快照区，启动时加载快照后
+ *             只需回放快照之后追加的记录，启动耗时不再随数据区大小增长。
+ *             快照区分为两个半区交替写入，写入中途掉电或最新快照校验失败时
+ *             退回另一半区的较旧快照。写入路径只计数，快照在空闲时保存。
+ *             条目之后保存各扇区的有效字节数，供GC选择回收扇区。
+ *             条目和扇区表经工作区的I/O缓冲分块读写。
+ * @author EasyData
+ * @date 2026-02-25
+ * @version 1.0.0
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "flash_kv_checkpoint.h"
+#include "flash_kv_hash.h"
+#include "flash_kv_crc.h"
+
+static uint32_t kv_ckpt_slot_addr(const kv_handle_t *handle, uint8_t slot)
+{
+    return handle->ckpt_addr + slot * (handle->ckpt_size / 2);
+}
+
+static uint32_t kv_ckpt_header_crc(const kv_checkpoint_header_t *header)
+{
+    return kv_crc32_update(KV_CRC32_INIT, (const uint8_t *)header,
+                           offsetof(kv_checkpoint_header_t, crc32));
+}
+
+/* 半区内容字节数：头部 + 条目 + 扇区有效字节表 */
+static uint32_t kv_ckpt_bytes(uint32_t entry_count, uint32_t sector_count)
+{
+    return sizeof(kv_checkpoint_header_t) + entry_count * sizeof(kv_checkpoint_entry_t) +
+           sector_count * sizeof(uint32_t);
+}
+
+static int kv_ckpt_header_read(const kv_handle_t *handle, uint8_t slot,
+                               kv_checkpoint_header_t *header)
+{
+    if (handle->ops->read(kv_ckpt_slot_addr(handle, slot), (uint8_t *)header,
+                          sizeof(*header)) != 0) {
+        return -1;
+    }
+    return (header->magic == KV_CHECKPOINT_MAGIC) ? 0 : -1;
+}
+
+/* slot半区是否为完整的快照：头部有效且头部、条目和扇区表的CRC相符。
+ * 经I/O缓冲分块读取，不逐条读取记录 */
+static bool kv_ckpt_slot_valid(const kv_handle_t *handle, uint8_t slot,
+                               kv_checkpoint_header_t *header)
+{
+    if (kv_ckpt_header_read(handle, slot, header) != 0 || header->seq == 0xFFFFFFFF ||
+        header->sector_count != handle->sector_count ||
+        header->entry_count > handle->ckpt_size / sizeof(kv_checkpoint_entry_t) ||
+        kv_ckpt_bytes(header->entry_count, header->sector_count) > handle->ckpt_size / 2) {
+        return false;
+    }
+
+    uint32_t addr = kv_ckpt_slot_addr(handle, slot) + sizeof(*header);
+    uint32_t remaining = kv_ckpt_bytes(header->entry_count, header->sector_count) -
+                         sizeof(*header);
+    uint32_t crc = kv_ckpt_header_crc(header);
+
+    while (remaining > 0) {
+        uint32_t n = (remaining < handle->io_size) ? remaining : handle->io_size;
+        if (handle->ops->read(addr, handle->io_buf, n) != 0) {
+            return false;
+        }
+        crc = kv_crc32_update(crc, handle->io_buf, n);
+        addr += n;
+        remaining -= n;
+    }
+    return kv_crc32_final(crc) == header->crc32;
+}
+
+void kv_checkpoint_attach(kv_handle_t *handle, uint32_t addr, uint32_t size)
+{
+    handle->ckpt_addr = addr;
+    handle->ckpt_size = 0;
+    handle->ckpt_seq = 0;
+    handle->ckpt_slot = 0;
+    handle->ckpt_writes = 0;
+
+    /* 每个半区必须是整块，才能单独擦除 */
+    if (size == 0 || handle->block_size == 0 ||
+        (size / 2) % handle->block_size != 0 || size / 2 == 0) {
+        return;
+    }
+    handle->ckpt_size = size;
+
+    /* 两个半区都校验CRC，最新的半区写入中途掉电或已损坏时使用另一半区的较旧快照，
+     * 下次保存覆盖损坏的半区 */
+    kv_checkpoint_header_t header;
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        if (kv_ckpt_slot_valid(handle, slot, &header) && header.seq > handle->ckpt_seq) {
+            handle->ckpt_seq = header.seq;
+            handle->ckpt_slot = slot;
+        }
+    }
+}
+
+/* 把一个快照条目插入索引；条目所在扇区在快照之后已被回收 (空闲或重新打开，
+ * 序号大于快照时最新的扇区) 时跳过，其中的有效记录已搬移到快照之后的日志，回放时恢复 */
+static int kv_ckpt_entry_load(kv_handle_t *handle, kv_hash_table_t *table,
+                              const kv_checkpoint_entry_t *entry, uint32_t max_seq)
+{
+    if (entry->flash_offset >= handle->total_size) {
+        return -1;
+    }
+    uint32_t seq = handle->sectors[entry->flash_offset / handle->block_size].seq;
+    if (seq == KV_SECTOR_FREE || seq > max_seq) {
+        return 0;
+    }
+
+#if FLASH_KV_INDEX_FINGERPRINT
+    return kv_hash_load(table, entry->fingerprint, entry->flash_offset);
+#else
+    /* 完整key模式需要从记录中取回key，仍远少于扫描整个日志 */
+    kv_record_key_t record;
+
+    if (handle->ops->read(handle->base_addr + entry->flash_offset, (uint8_t *)&record,
+                          sizeof(record)) != 0 ||
+        record.header.magic != KV_RECORD_MAGIC ||
+        !(record.header.flags & KV_RECORD_FLAG_TOMBSTONE) ||
+        record.header.key_len == 0 || record.header.key_len > FLASH_KV_KEY_SIZE) {
+        return -1;
+    }
+    return kv_hash_set(table, record.key, record.header.key_len,
+                       entry->flash_offset, NULL);
+#endif
+}
+
+/* 快照中的追加扇区仍是同一次打开的同一流的扇区，且追加位置在其头部之后 */
+static int kv_ckpt_head_check(const kv_handle_t *handle, uint32_t seq, uint32_t offset,
+                              bool cold, uint32_t *idx)
+{
+    if (seq == KV_SECTOR_FREE || offset == 0 || offset > handle->total_size) {
+        return -1;
+    }
+    *idx = (offset - 1) / handle->block_size;
+    const kv_sector_t *sector = &handle->sectors[*idx];
+    if (sector->seq != seq || sector->cold != (cold ? 1 : 0) ||
+        offset < *idx * handle->block_size + sizeof(kv_sector_header_t)) {
+        return -1;
+    }
+    return 0;
+}
+
+int kv_checkpoint_load(kv_handle_t *handle, kv_hash_table_t *table)
+{
+    if (handle->ckpt_size == 0 || handle->ckpt_seq == 0) {
+        return -1;
+    }
+
+    /* 快照时两个流的追加扇区仍是同一次打开的扇区 (序号相同) 才可用，
+     * 追加位置恰在扇区末尾时属于前一个字节所在的扇区 */
+    kv_checkpoint_header_t header;
+    uint32_t head, cold = KV_SECTOR_NONE;
+    if (kv_ckpt_header_read(handle, handle->ckpt_slot, &header) != 0 ||
+        kv_ckpt_head_check(handle, header.head_seq, header.write_offset, false, &head) != 0 ||
+        (header.cold_seq != KV_SECTOR_FREE &&
+         kv_ckpt_head_check(handle, header.cold_seq, header.cold_offset, true, &cold) != 0) ||
+        header.sector_count != handle->sector_count ||
+        kv_hash_reserve(table, header.entry_count) != 0 ||
+        kv_ckpt_bytes(header.entry_count, header.sector_count) > handle->ckpt_size / 2) {
+        return -1;
+    }
+
+    uint32_t max_seq = header.head_seq;
+    if (header.cold_seq != KV_SECTOR_FREE && header.cold_seq > max_seq) {
+        max_seq = header.cold_seq;
+    }
+    uint32_t addr = kv_ckpt_slot_addr(handle, handle->ckpt_slot) + sizeof(header);
+    uint32_t crc = kv_ckpt_header_crc(&header);
+    kv_checkpoint_entry_t *chunk = (kv_checkpoint_entry_t *)handle->io_buf;
+    uint32_t chunk_entries = handle->io_size / sizeof(kv_checkpoint_entry_t);
+    uint32_t remaining = header.entry_count;
+
+    while (remaining > 0) {
+        uint32_t n = (remaining < chunk_entries) ? remaining : chunk_entries;
+        if (handle->ops->read(addr, (uint8_t *)chunk, n * sizeof(chunk[0])) != 0) {
+            return -1;
+        }
+        crc = kv_crc32_update(crc, (const uint8_t *)chunk, n * sizeof(chunk[0]));
+        for (uint32_t i = 0; i < n; i++) {
+            if (kv_ckpt_entry_load(handle, table, &chunk[i], max_seq) != 0) {
+                return -1;
+            }
+        }
+        addr += n * sizeof(chunk[0]);
+        remaining -= n;
+    }
+
+    /* 快照之后被回收的扇区 (空闲或已重新打开) 中的条目已跳过，其有效字节不计入 */
+    uint32_t *live = (uint32_t *)handle->io_buf;
+    uint32_t chunk_sectors = handle->io_size / sizeof(uint32_t);
+    uint32_t live_bytes = 0;
+
+    for (uint32_t idx = 0; idx < header.sector_count; ) {
+        uint32_t n = header.sector_count - idx;
+        if (n > chunk_sectors) {
+            n = chunk_sectors;
+        }
+        if (handle->ops->read(addr, (uint8_t *)live, n * sizeof(live[0])) != 0) {
+            return -1;
+        }
+        crc = kv_crc32_update(crc, (const uint8_t *)live, n * sizeof(live[0]));
+        for (uint32_t i = 0; i < n; i++, idx++) {
+            uint32_t seq = handle->sectors[idx].seq;
+            if (seq == KV_SECTOR_FREE || seq > max_seq ||
+                live[i] > handle->block_size) {
+                live[i] = 0;
+            }
+            handle->sectors[idx].live = live[i];
+            live_bytes += live[i];
+        }
+        addr += n * sizeof(live[0]);
+    }
+
+    /* 绑定时已校验过CRC，这里校验本次读取的内容；条目已插入，
+     * CRC不符时由调用者丢弃索引改为全量扫描 */
+    if (kv_crc32_final(crc) != header.crc32) {
+        return -1;
+    }
+
+    handle->head_sector = head;
+    handle->write_offset = header.write_offset;
+    handle->cold_sector = cold;
+    handle->cold_offset = header.cold_offset;
+    handle->next_seq = header.next_seq;
+    handle->live_bytes = live_bytes;
+    return 0;
+}
+
+int kv_checkpoint_save(kv_handle_t *handle, const kv_hash_table_t *table)
+{
+    if (handle->ckpt_size == 0) {
+        return KV_OK;
+    }
+    if (kv_ckpt_bytes(table->count, handle->sector_count) > handle->ckpt_size / 2) {
+        return KV_ERR_NO_SPACE;
+    }
+
+    uint8_t slot = (handle->ckpt_seq == 0) ? 0 : (uint8_t)(handle->ckpt_slot ^ 1);
+    uint32_t slot_addr = kv_ckpt_slot_addr(handle, slot);
+    if (handle->ops->erase(slot_addr, handle->ckpt_size / 2) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    kv_checkpoint_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = KV_CHECKPOINT_MAGIC;
+    header.seq = handle->ckpt_seq + 1;
+    header.head_seq = handle->sectors[handle->head_sector].seq;
+    header.write_offset = handle->write_offset;
+    if (handle->cold_sector != KV_SECTOR_NONE) {
+        header.cold_seq = handle->sectors[handle->cold_sector].seq;
+        header.cold_offset = handle->cold_offset;
+    }
+    header.next_seq = handle->next_seq;
+    header.entry_count = table->count;
+    header.sector_count = handle->sector_count;
+
+    uint32_t crc = kv_ckpt_header_crc(&header);
+    uint32_t addr = slot_addr + sizeof(header);
+    kv_checkpoint_entry_t *chunk = (kv_checkpoint_entry_t *)handle->io_buf;
+    uint32_t chunk_entries = handle->io_size / sizeof(kv_checkpoint_entry_t);
+    uint32_t n = 0;
+
+    uint32_t slot_count = kv_hash_slot_count(table);
+    for (uint32_t idx = 0; idx < slot_count; idx++) {
+        if (kv_hash_entry_at(table, idx, &chunk[n].fingerprint,
+                             &chunk[n].flash_offset) != 0) {
+            continue;
+        }
+        if (++n == chunk_entries) {
+            crc = kv_crc32_update(crc, (const uint8_t *)chunk, n * sizeof(chunk[0]));
+            if (handle->ops->write(addr, (const uint8_t *)chunk, n * sizeof(chunk[0])) != 0) {
+                return KV_ERR_FLASH_FAIL;
+            }
+            addr += n * sizeof(chunk[0]);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        crc = kv_crc32_update(crc, (const uint8_t *)chunk, n * sizeof(chunk[0]));
+        if (handle->ops->write(addr, (const uint8_t *)chunk, n * sizeof(chunk[0])) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+        addr += n * sizeof(chunk[0]);
+    }
+
+    /* 各扇区有效字节数，空闲扇区为0 */
+    uint32_t *live = (uint32_t *)handle->io_buf;
+    uint32_t chunk_sectors = handle->io_size / sizeof(uint32_t);
+    for (uint32_t idx = 0; idx < handle->sector_count; ) {
+        uint32_t count = handle->sector_count - idx;
+        if (count > chunk_sectors) {
+            count = chunk_sectors;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            live[i] = handle->sectors[idx + i].live;
+        }
+        crc = kv_crc32_update(crc, (const uint8_t *)live, count * sizeof(live[0]));
+        if (handle->ops->write(addr, (const uint8_t *)live, count * sizeof(live[0])) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+        addr += count * sizeof(live[0]);
+        idx += count;
+    }
+
+    /* 头部最后写入，作为快照的提交点 */
+    header.crc32 = kv_crc32_final(crc);
+    if (handle->ops->write(slot_addr, (const uint8_t *)&header, sizeof(header)) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    handle->ckpt_seq = header.seq;
+    handle->ckpt_slot = slot;
+    handle->ckpt_writes = 0;
+    return KV_OK;
+}
+
+void kv_checkpoint_tick(kv_handle_t *handle)
+{
+    handle->ckpt_writes++;
+}
+
+bool kv_checkpoint_due(const kv_handle_t *handle)
+{
+    return handle->ckpt_size != 0 && handle->ckpt_writes >= FLASH_KV_CHECKPOINT_INTERVAL;
+}
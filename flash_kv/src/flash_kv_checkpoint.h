@@ -0,0 +1,30 @@
+/**
+ * @file flash_kv_checkpoint.h
+ * @brief 索引快照接口头文件
+ * @description 索引快照的保存、加载与作废接口声明
+ * @author EasyData
+ * @date 2026-02-25
+ * @version 1.0.0
+ */
+
+#ifndef FLASH_KV_CHECKPOINT_H
+#define FLASH_KV_CHECKPOINT_H
+
+#include "flash_kv_types.h"
+
+/* 绑定快照区并校验两个半区，确定CRC有效的最新快照 */
+void kv_checkpoint_attach(kv_handle_t *handle, uint32_t addr, uint32_t size);
+
+/* 加载日志头仍有效的最新快照，成功后handle->head_sector/write_offset为回放起点 */
+int kv_checkpoint_load(kv_handle_t *handle, kv_hash_table_t *table);
+
+/* 擦除较旧的半区并写入索引；有擦除和O(条目数)次写入，不在写入路径上调用 */
+int kv_checkpoint_save(kv_handle_t *handle, const kv_hash_table_t *table);
+
+/* 记录一次写入，只计数不保存 */
+void kv_checkpoint_tick(kv_handle_t *handle);
+
+/* 自最新快照以来写入达到FLASH_KV_CHECKPOINT_INTERVAL，应在空闲时保存快照 */
+bool kv_checkpoint_due(const kv_handle_t *handle);
+
+#endif
@@ -5,78 +5,304 @@
  *             - 基本的KV操作 (set/get/del/exists)
  *             - 垃圾回收 (GC)
  *             - 事务支持 (begin/commit/rollback)
- *             - 双区域备份 (A/B区域切换)
+ *             - 扇区环形日志 (热数据和冷数据分流写入，按收益选择回收扇区)
  * @author EasyData
  * @date 2026-02-25
  * @version 1.0.0
  */
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include "flash_kv.h"
 #include "flash_kv_hash.h"
 #include "flash_kv_crc.h"
+#include "flash_kv_checkpoint.h"
+#include "flash_kv_cache.h"
+
+#if FLASH_KV_BLANK_CHECK && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* 全局句柄 */
 static kv_handle_t g_handles[FLASH_KV_INSTANCE_MAX];
-static kv_hash_table_t g_hash_table;
 static const flash_kv_ops_t *g_flash_ops = NULL;
-static uint8_t g_initialized = 0;
 
-/* 事务相关变量 */
-static kv_record_t g_tx_pending_record = {0};
-static uint8_t g_tx_pending = 0;  /* 0: 无挂起, 1: 有挂起记录 */
+/* 内置工作区和flash_kv_workspace_size建议的I/O缓冲长度 */
+#define KV_IO_DEFAULT_SIZE  ((FLASH_KV_IO_BUF_SIZE > KV_IO_BUF_SIZE) ? \
+                             FLASH_KV_IO_BUF_SIZE : KV_IO_BUF_SIZE)
+
+#if FLASH_KV_STATIC_WORKSPACE
+/* 内置工作区，config->workspace为NULL时使用 */
+static uint32_t g_index_bufs[FLASH_KV_INSTANCE_MAX][KV_INDEX_BUF_SIZE(FLASH_KV_HASH_SIZE) / 4];
+static uint32_t g_io_bufs[FLASH_KV_INSTANCE_MAX][(KV_IO_DEFAULT_SIZE + 3) / 4];
+static uint32_t g_tx_bufs[FLASH_KV_INSTANCE_MAX][(FLASH_KV_TX_BUF_SIZE + 3) / 4];
+#if FLASH_KV_CACHE_ENTRIES > 0
+static kv_cache_entry_t g_cache_bufs[FLASH_KV_INSTANCE_MAX][FLASH_KV_CACHE_ENTRIES];
+#endif
+#if FLASH_KV_DIRTY_ENTRIES > 0
+static kv_dirty_entry_t g_dirty_bufs[FLASH_KV_INSTANCE_MAX][FLASH_KV_DIRTY_ENTRIES];
+#endif
+#endif
 
 /* 前向声明 */
 static void kv_hash_rebuild(kv_handle_t *handle);
+static int kv_gc_start(kv_handle_t *handle, uint32_t max_seq, uint32_t min_dead);
+static bool kv_gc_wanted(const kv_handle_t *handle);
+static bool kv_index_key_match(void *ctx, uint32_t offset,
+                               const uint8_t *key, uint8_t key_len);
+static int kv_dirty_flush(kv_handle_t *handle, bool all);
+static int kv_mset_log(kv_handle_t *handle, kv_item_t *items, uint32_t count);
+
+/* 单条记录最大长度 */
+#define KV_RECORD_MAX_SIZE  KV_RECORD_SIZE(FLASH_KV_KEY_SIZE, FLASH_KV_VALUE_SIZE)
+
+/* 批量提交标记长度 (value为4字节的本批记录总长) */
+#define KV_COMMIT_SIZE      KV_RECORD_SIZE(0, sizeof(uint32_t))
+
+/* 扇区在数据区内的起始偏移 */
+static uint32_t kv_sector_start(const kv_handle_t *handle, uint32_t idx)
+{
+    return idx * handle->block_size;
+}
+
+/* 扇区中可存放记录的字节数 */
+static uint32_t kv_sector_payload(const kv_handle_t *handle)
+{
+    return handle->block_size - sizeof(kv_sector_header_t);
+}
+
+/* 计算扇区头部CRC */
+static uint32_t kv_sector_header_crc(const kv_sector_header_t *header)
+{
+    return kv_crc32((const uint8_t *)header, offsetof(kv_sector_header_t, crc32));
+}
+
+/* 读取扇区头部，无效或已有回收标记 (含写了一部分的标记) 时返回-1 */
+static int kv_sector_header_read(const kv_handle_t *handle, uint32_t idx,
+                                 kv_sector_header_t *header)
+{
+    if (handle->ops->read(handle->base_addr + kv_sector_start(handle, idx),
+                          (uint8_t *)header, sizeof(*header)) != 0 ||
+        header->magic != KV_SECTOR_MAGIC || header->seq == KV_SECTOR_FREE ||
+        kv_sector_header_crc(header) != header->crc32) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < sizeof(header->retired); i++) {
+        if (header->retired[i] != 0xFF) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if FLASH_KV_BLANK_CHECK
+/* 缓冲区是否全为0xFF：按字比较，x86 SSE2主机构建每次比较16字节；len为4的倍数 */
+static bool kv_buf_blank(const uint8_t *buf, uint32_t len)
+{
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, ones)) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    for (; i < len; i += 4) {
+        if (*(const uint32_t *)(buf + i) != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* 分块读出扇区，检查是否已是擦除态；I/O缓冲中可能有待写入的记录，使用栈上缓冲 */
+static bool kv_sector_blank(const kv_handle_t *handle, uint32_t idx)
+{
+    uint32_t addr = handle->base_addr + kv_sector_start(handle, idx);
+    uint32_t chunk[16];
+
+    for (uint32_t done = 0; done < handle->block_size; done += sizeof(chunk)) {
+        uint32_t len = handle->block_size - done;
+        if (len > sizeof(chunk)) {
+            len = sizeof(chunk);
+        }
+        if (handle->ops->read(addr + done, (uint8_t *)chunk, len) != 0 ||
+            !kv_buf_blank((const uint8_t *)chunk, len)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
 
-/* 读取区域头部 */
-static int kv_region_header_read(kv_handle_t *handle, uint8_t region,
-                                kv_region_header_t *header)
+/* 擦除空闲扇区，之后打开时无需再擦除；已是擦除态的扇区跳过擦除 */
+static int kv_sector_erase(kv_handle_t *handle, uint32_t idx)
 {
-    if (handle->ops->read(handle->region_addr[region],
-                         (uint8_t *)header, sizeof(*header)) != 0) {
+    kv_sector_t *sector = &handle->sectors[idx];
+
+#if FLASH_KV_BLANK_CHECK
+    if (kv_sector_blank(handle, idx)) {
+        sector->erased = 1;
+        sector->record_seq = KV_SECTOR_FREE;
+        return 0;
+    }
+#endif
+    sector->erase_gen++;
+    if (handle->ops->erase(handle->base_addr + kv_sector_start(handle, idx),
+                           handle->block_size) != 0) {
         return -1;
     }
+    sector->erased = 1;
+    sector->record_seq = KV_SECTOR_FREE;
     return 0;
 }
 
-/* 验证区域头部有效性 */
-static int kv_region_header_valid(const kv_region_header_t *header)
+/* 打开空闲扇区作为热数据或冷数据流的追加扇区：未擦除时先擦除 (未预擦除时写入
+ * 在此等待擦除)，再写入序号递增的头部 */
+static int kv_sector_open(kv_handle_t *handle, uint32_t idx, bool cold)
 {
-    /* 验证魔术字 */
-    if (header->magic != KV_MAGIC && header->magic != KV_MAGIC_B) {
+    kv_sector_t *sector = &handle->sectors[idx];
+    uint32_t addr = handle->base_addr + kv_sector_start(handle, idx);
+
+    if (!sector->erased && kv_sector_erase(handle, idx) != 0) {
         return -1;
     }
 
-    /* 验证CRC */
-    uint32_t crc = kv_crc32((const uint8_t *)header,
-                           sizeof(kv_region_header_t) - 4);
-    if (crc != header->crc32) {
+    kv_sector_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = KV_SECTOR_MAGIC;
+    if (cold) {
+        header.flags &= (uint8_t)~KV_SECTOR_FLAG_COLD;
+    }
+    header.seq = handle->sector_seq + 1;
+    header.record_seq = handle->next_seq;
+    header.crc32 = kv_sector_header_crc(&header);
+
+    /* 头部可能已部分编程，该扇区下次打开前要重新擦除；回收标记单独编程，此时不写 */
+    sector->erased = 0;
+    if (handle->ops->write(addr, (const uint8_t *)&header,
+                           offsetof(kv_sector_header_t, retired)) != 0) {
         return -1;
     }
 
+    handle->sector_seq = header.seq;
+    sector->seq = header.seq;
+    sector->live = 0;
+    sector->record_seq = header.record_seq;
+    sector->cold = cold ? 1 : 0;
+    handle->free_sectors--;
+    if (cold) {
+        handle->cold_sector = idx;
+        handle->cold_offset = kv_sector_start(handle, idx) + sizeof(header);
+    } else {
+        handle->head_sector = idx;
+        handle->write_offset = kv_sector_start(handle, idx) + sizeof(header);
+    }
     return 0;
 }
 
-/* 初始化区域头部 */
-static int kv_region_header_init(kv_handle_t *handle, uint8_t region)
+/* 是否为热数据或冷数据流正在追加的扇区 */
+static bool kv_sector_is_head(const kv_handle_t *handle, uint32_t idx)
 {
-    kv_region_header_t header = {0};
-    header.magic = KV_MAGIC;
-    header.version = 1;
-    header.record_count = 0;
-    header.active_offset = sizeof(kv_region_header_t);
-    header.tx_state = KV_TX_STATE_IDLE;
-    header.crc32 = kv_crc32((const uint8_t *)&header,
-                            sizeof(kv_region_header_t) - 4);
+    return idx == handle->head_sector || idx == handle->cold_sector;
+}
 
-    /* 擦除并写入头部 */
-    if (handle->ops->erase(handle->region_addr[region], handle->region_size) != 0) {
-        return -1;
+/* 从日志头之后按环形顺序查找空闲扇区，优先已擦除的扇区，没有空闲扇区时返回-1 */
+static int kv_sector_next_free(const kv_handle_t *handle)
+{
+    int found = -1;
+
+    for (uint32_t i = 1; i <= handle->sector_count; i++) {
+        uint32_t idx = (handle->head_sector + i) % handle->sector_count;
+        if (handle->sectors[idx].seq != KV_SECTOR_FREE) {
+            continue;
+        }
+        if (handle->sectors[idx].erased) {
+            return (int)idx;
+        }
+        if (found < 0) {
+            found = (int)idx;
+        }
+    }
+    return found;
+}
+
+/* 热数据或冷数据流中序号最小 (最旧) 的扇区，没有时返回-1 */
+static int kv_sector_first(const kv_handle_t *handle, bool cold)
+{
+    int first = -1;
+
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        const kv_sector_t *sector = &handle->sectors[i];
+        if (sector->seq != KV_SECTOR_FREE && sector->cold == (cold ? 1 : 0) &&
+            (first < 0 || sector->seq < handle->sectors[first].seq)) {
+            first = (int)i;
+        }
+    }
+    return first;
+}
+
+/* 同一流的回放顺序中紧随idx之后的扇区，idx已是该流最新的扇区时返回-1 */
+static int kv_sector_after(const kv_handle_t *handle, uint32_t idx)
+{
+    uint32_t after = handle->sectors[idx].seq;
+    uint8_t cold = handle->sectors[idx].cold;
+    int next = -1;
+
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        const kv_sector_t *sector = &handle->sectors[i];
+        if (sector->seq != KV_SECTOR_FREE && sector->cold == cold && sector->seq > after &&
+            (next < 0 || sector->seq < handle->sectors[next].seq)) {
+            next = (int)i;
+        }
+    }
+    return next;
+}
+
+/* 读取所有扇区头部建立扇区表，头部无效的扇区视为空闲 (打开前擦除)；
+ * 各流序号最大的扇区为其追加扇区，没有热数据扇区时返回false */
+static bool kv_sector_scan(kv_handle_t *handle)
+{
+    bool hot = false;
+
+    handle->sector_seq = 0;
+    handle->free_sectors = 0;
+    handle->head_sector = handle->sector_count - 1;
+    handle->cold_sector = KV_SECTOR_NONE;
+
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        kv_sector_t *sector = &handle->sectors[i];
+        kv_sector_header_t header;
+
+        memset(sector, 0, sizeof(*sector));
+        if (kv_sector_header_read(handle, i, &header) != 0) {
+            sector->seq = KV_SECTOR_FREE;
+            sector->record_seq = KV_SECTOR_FREE;
+            handle->free_sectors++;
+            continue;
+        }
+        sector->seq = header.seq;
+        sector->record_seq = header.record_seq;
+        sector->cold = (header.flags & KV_SECTOR_FLAG_COLD) ? 0 : 1;
+        if (sector->seq > handle->sector_seq) {
+            handle->sector_seq = sector->seq;
+        }
+        if (sector->cold) {
+            if (handle->cold_sector == KV_SECTOR_NONE ||
+                sector->seq > handle->sectors[handle->cold_sector].seq) {
+                handle->cold_sector = i;
+            }
+        } else if (!hot || sector->seq > handle->sectors[handle->head_sector].seq) {
+            handle->head_sector = i;
+            hot = true;
+        }
     }
-    return handle->ops->write(handle->region_addr[region],
-                             (const uint8_t *)&header, sizeof(header));
+    return hot;
 }
 
 /* 初始化Flash适配器 */
@@ -95,6 +321,111 @@ const flash_kv_ops_t* flash_kv_adapter_get(void)
     return g_flash_ops;
 }
 
+/* 索引缓冲区可容纳的槽数 (不超过的最大2的幂) */
+static uint32_t kv_index_slots(uint32_t bytes)
+{
+    uint32_t slots = 1;
+    while (KV_INDEX_BUF_SIZE(slots * 2) <= bytes) {
+        slots *= 2;
+    }
+    return (KV_INDEX_BUF_SIZE(slots) <= bytes) ? slots : 0;
+}
+
+/* 容纳max_keys个key的槽数：Robin Hood置换使负载87.5%时探测距离仍然较短 */
+static uint32_t kv_index_slots_for(uint32_t max_keys)
+{
+    uint32_t slots = 2;
+    while (slots * 7 < max_keys * 8) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+/* 计算工作区大小 */
+uint32_t flash_kv_workspace_size(uint32_t max_keys, kv_workspace_t *ws)
+{
+    uint32_t index_size = KV_INDEX_BUF_SIZE(kv_index_slots_for(max_keys));
+    uint32_t io_size = (KV_IO_DEFAULT_SIZE + 3) & ~3u;
+    if (ws != NULL) {
+        ws->index_size = index_size;
+        ws->io_size = io_size;
+        ws->cache_buf = NULL;
+        ws->cache_size = 0;
+        ws->tx_buf = NULL;
+        ws->tx_size = 0;
+        ws->dirty_buf = NULL;
+        ws->dirty_size = 0;
+    }
+    return index_size + io_size;
+}
+
+/* 绑定工作区：索引槽和I/O缓冲来自调用者或内置静态工作区，配置了分配器时索引从分配器分配 */
+static int kv_workspace_attach(kv_handle_t *handle, uint8_t instance_id,
+                               const kv_instance_config_t *config)
+{
+    const kv_workspace_t *ws = config->workspace;
+    const kv_allocator_t *allocator = config->allocator;
+    kv_hash_slot_t *slots = NULL;
+    uint32_t slot_count = 0;
+
+    if (ws == NULL) {
+#if FLASH_KV_STATIC_WORKSPACE
+        slots = (kv_hash_slot_t *)g_index_bufs[instance_id];
+        slot_count = FLASH_KV_HASH_SIZE;
+        handle->io_buf = (uint8_t *)g_io_bufs[instance_id];
+        handle->io_size = sizeof(g_io_bufs[instance_id]);
+        handle->tx_buf = (uint8_t *)g_tx_bufs[instance_id];
+        handle->tx_size = sizeof(g_tx_bufs[instance_id]);
+#if FLASH_KV_CACHE_ENTRIES > 0
+        kv_cache_attach(handle, g_cache_bufs[instance_id], sizeof(g_cache_bufs[instance_id]));
+#endif
+#if FLASH_KV_DIRTY_ENTRIES > 0
+        handle->dirty = g_dirty_bufs[instance_id];
+        handle->dirty_entries = FLASH_KV_DIRTY_ENTRIES;
+#endif
+#else
+        (void)instance_id;
+        return KV_ERR_INVALID_PARAM;
+#endif
+    } else {
+        (void)instance_id;
+        slot_count = kv_index_slots(ws->index_size);
+        if ((allocator == NULL &&
+             (ws->index_buf == NULL || ((uintptr_t)ws->index_buf & 3) != 0 || slot_count < 2)) ||
+            ws->io_buf == NULL || ((uintptr_t)ws->io_buf & 3) != 0 ||
+            ws->io_size < KV_IO_BUF_SIZE || ((uintptr_t)ws->tx_buf & 3) != 0 ||
+            ((uintptr_t)ws->cache_buf & 3) != 0 || ((uintptr_t)ws->dirty_buf & 3) != 0) {
+            return KV_ERR_INVALID_PARAM;
+        }
+        slots = (kv_hash_slot_t *)ws->index_buf;
+        handle->io_buf = (uint8_t *)ws->io_buf;
+        handle->io_size = ws->io_size;
+        kv_cache_attach(handle, ws->cache_buf, ws->cache_size);
+        handle->dirty = (kv_dirty_entry_t *)ws->dirty_buf;
+        handle->dirty_entries = ws->dirty_buf ? ws->dirty_size / sizeof(kv_dirty_entry_t) : 0;
+        handle->tx_buf = (uint8_t *)ws->tx_buf;
+        handle->tx_size = ws->tx_buf ? ws->tx_size : 0;
+    }
+
+    if (allocator == NULL) {
+        kv_hash_init(&handle->index, slots, slot_count, kv_index_key_match, handle);
+    } else {
+        slot_count = kv_index_slots_for(config->index_keys);
+        if (slot_count < KV_HASH_GROUP) {
+            slot_count = KV_HASH_GROUP;
+        }
+        if (allocator->alloc == NULL || allocator->free == NULL ||
+            kv_hash_init_alloc(&handle->index, allocator, slot_count,
+                               kv_index_key_match, handle) != 0) {
+            return KV_ERR_INVALID_PARAM;
+        }
+    }
+    for (uint32_t i = 0; i < handle->dirty_entries; i++) {
+        handle->dirty[i].key_len = 0;
+    }
+    return KV_OK;
+}
+
 /* 初始化KV存储 */
 int flash_kv_init(uint8_t instance_id, const kv_instance_config_t *config)
 {
@@ -106,75 +437,60 @@ int flash_kv_init(uint8_t instance_id, const kv_instance_config_t *config)
         return KV_ERR_NO_INIT;
     }
 
+    /* 重复初始化时释放上次分配的索引 */
     kv_handle_t *handle = &g_handles[instance_id];
+    kv_hash_release(&handle->index);
     memset(handle, 0, sizeof(kv_handle_t));
 
-    handle->instance_id = instance_id;
-    handle->ops = config->ops ? config->ops : g_flash_ops;
-    handle->region_addr[0] = config->start_addr;
-    handle->region_size = config->total_size / 2;
-    handle->block_size = config->block_size;
-    handle->region_addr[1] = config->start_addr + handle->region_size;
-    handle->active_region = 0;
-    handle->version = 1;
-
-    /* 双区域恢复：读取两个区域的头部 */
-    kv_region_header_t header0, header1;
-    int valid0 = kv_region_header_read(handle, 0, &header0);
-    int valid1 = kv_region_header_read(handle, 1, &header1);
-
-    /* 检查区域有效性 */
-    if (valid0 == 0 && kv_region_header_valid(&header0) == 0) {
-        /* 区域0有效 */
-    } else {
-        /* 区域0无效，初始化 */
-        kv_region_header_init(handle, 0);
+    if (kv_workspace_attach(handle, instance_id, config) != KV_OK) {
+        return KV_ERR_INVALID_PARAM;
     }
 
-    if (valid1 == 0 && kv_region_header_valid(&header1) == 0) {
-        /* 区域1有效 */
-    } else {
-        /* 区域1无效，初始化 */
-        kv_region_header_init(handle, 1);
+    /* 写回模式需要写回缓冲 */
+    handle->wb_delay = config->write_back_delay;
+    if (handle->wb_delay != 0 && handle->dirty_entries == 0) {
+        kv_hash_release(&handle->index);
+        return KV_ERR_INVALID_PARAM;
     }
 
-    /* 重新读取有效区域，选择版本号更大的 */
-    kv_region_header_read(handle, 0, &header0);
-    kv_region_header_read(handle, 1, &header1);
-
-    int valid0_new = (kv_region_header_valid(&header0) == 0);
-    int valid1_new = (kv_region_header_valid(&header1) == 0);
+    /* 数据区按擦除块划分为扇区：至少要有热数据和冷数据两个追加扇区、一个已写扇区
+     * 和留给GC的空闲扇区，每个扇区要能放下最大的记录 */
+    uint32_t sector_count = (config->block_size != 0) ?
+                            config->total_size / config->block_size : 0;
+    if (sector_count < 4 || sector_count > FLASH_KV_SECTOR_MAX ||
+        config->total_size % config->block_size != 0 ||
+        config->block_size < sizeof(kv_sector_header_t) + KV_RECORD_MAX_SIZE) {
+        kv_hash_release(&handle->index);
+        return KV_ERR_INVALID_PARAM;
+    }
 
-    if (valid0_new && valid1_new) {
-        /* 两个区域都有效，选择版本号更大的 */
-        if (header1.version >= header0.version) {
-            handle->active_region = 1;
-            handle->version = header1.version;
-        } else {
-            handle->active_region = 0;
-            handle->version = header0.version;
-        }
-    } else if (valid0_new) {
-        handle->active_region = 0;
-        handle->version = header0.version;
-    } else if (valid1_new) {
-        handle->active_region = 1;
-        handle->version = header1.version;
-    } else {
-        /* 两个区域都无效，使用默认 */
-        handle->active_region = 0;
+    handle->instance_id = instance_id;
+    handle->ops = config->ops ? config->ops : g_flash_ops;
+    handle->base_addr = config->start_addr;
+    handle->total_size = config->total_size;
+    handle->block_size = config->block_size;
+    handle->sector_count = sector_count;
+
+    /* 扇区序号决定流内的回放顺序；没有热数据扇区时打开一个空闲扇区作为日志头 */
+    if (!kv_sector_scan(handle)) {
+        int idx = kv_sector_next_free(handle);
+        if (idx < 0 || kv_sector_open(handle, (uint32_t)idx, false) != 0) {
+            handle->ops = NULL;
+            kv_hash_release(&handle->index);
+            return KV_ERR_FLASH_FAIL;
+        }
     }
 
-    /* 重建哈希表 */
+    /* 加载索引快照或回放日志重建哈希表 */
+    kv_checkpoint_attach(handle, config->checkpoint_addr, config->checkpoint_size);
     kv_hash_rebuild(handle);
 
-    g_initialized = 1;
     return KV_OK;
 }
 
 kv_handle_t* flash_kv_get_handle(uint8_t instance_id)
 {
-    if (instance_id >= FLASH_KV_INSTANCE_MAX || !g_initialized) {
+    if (instance_id >= FLASH_KV_INSTANCE_MAX || g_handles[instance_id].ops == NULL) {
         return NULL;
     }
     return &g_handles[instance_id];
@@ -185,368 +501,1993 @@ int flash_kv_deinit(uint8_t instance_id)
     if (instance_id >= FLASH_KV_INSTANCE_MAX) {
         return KV_ERR_INVALID_PARAM;
     }
-    g_initialized = 0;
-    return KV_OK;
+
+    /* 写回缓冲中的值在卸载前写入 */
+    kv_handle_t *handle = &g_handles[instance_id];
+    int ret = (handle->ops != NULL) ? kv_dirty_flush(handle, true) : KV_OK;
+    handle->ops = NULL;
+    kv_hash_release(&handle->index);
+    return ret;
 }
 
-/* 验证记录CRC */
-static int kv_record_check_crc(const kv_record_t *record)
+/* 句柄是否已初始化 */
+static bool kv_handle_ready(const kv_handle_t *handle)
 {
-    uint16_t crc = kv_crc16((const uint8_t *)record,
-                            sizeof(kv_record_t) - 2);
-    return (crc == record->crc16) ? 0 : -1;
+    return handle != NULL && handle->ops != NULL;
 }
 
-/* 重建哈希表 - 从Flash扫描有效记录 */
-static void kv_hash_rebuild(kv_handle_t *handle)
+/* key长度是否在1~FLASH_KV_KEY_SIZE之间：更长的key不可能存在，指纹模式比对时也不能读入key缓冲 */
+static bool kv_key_valid(const uint8_t *key, uint8_t key_len)
 {
-    kv_hash_init(&g_hash_table);
-
-    uint32_t region_addr = handle->region_addr[handle->active_region];
-    uint32_t offset = sizeof(kv_region_header_t);
-    kv_record_t record;
+    return key != NULL && key_len != 0 && key_len <= FLASH_KV_KEY_SIZE;
+}
 
-    while (offset < handle->region_size - handle->block_size) {
-        if (handle->ops->read(region_addr + offset, (uint8_t *)&record,
-                             sizeof(record)) != 0) {
-            break;
-        }
+/* 计算记录CRC */
+static uint16_t kv_record_crc(const kv_record_t *record)
+{
+    const kv_record_header_t *h = &record->header;
+    uint16_t crc = kv_crc16_update(KV_CRC16_INIT, (const uint8_t *)h,
+                                   offsetof(kv_record_header_t, crc16));
+    crc = kv_crc16_update(crc, (const uint8_t *)&h->seq, sizeof(h->seq));
+    return kv_crc16_update(crc, record->data, h->key_len + h->value_len);
+}
 
-        if (kv_record_check_crc(&record) == 0 && record.flags == 1) {
-            kv_hash_set(&g_hash_table, record.key, record.key_len,
-                       offset);
-            handle->record_count++;
-        }
-        offset += sizeof(kv_record_t);
-    }
+/* 验证记录CRC */
+static int kv_record_check_crc(const kv_record_t *record)
+{
+    return (kv_record_crc(record) == record->header.crc16) ? 0 : -1;
 }
 
-/* 写入记录 */
-static int kv_record_write(kv_handle_t *handle, uint32_t offset,
-                          const kv_record_t *record)
+/* 是否为删除标记 */
+static bool kv_record_is_tombstone(const kv_record_header_t *header)
 {
-    kv_record_t r = *record;
-    r.crc16 = kv_crc16((const uint8_t *)&r,
-                       sizeof(kv_record_t) - 2);
-    return handle->ops->write(offset, (const uint8_t *)&r, sizeof(r));
+    return (header->flags & KV_RECORD_FLAG_TOMBSTONE) == 0;
 }
 
-/* KV设置 */
-int flash_kv_set(const uint8_t *key, uint8_t key_len,
-                 const uint8_t *value, uint8_t value_len)
+/* 是否为批量写入的记录 */
+static bool kv_record_is_batch(const kv_record_header_t *header)
 {
-    if (key == NULL || value == NULL || key_len == 0 ||
-        key_len > FLASH_KV_KEY_SIZE || value_len > FLASH_KV_VALUE_SIZE) {
-        return KV_ERR_INVALID_PARAM;
-    }
+    return (header->flags & KV_RECORD_FLAG_BATCH) == 0;
+}
 
-    kv_handle_t *handle = &g_handles[0];
-    if (handle->ops == NULL) {
-        return KV_ERR_NO_INIT;
-    }
+/* 是否为批量提交标记 */
+static bool kv_record_is_commit(const kv_record_header_t *header)
+{
+    return (header->flags & KV_RECORD_FLAG_COMMIT) == 0;
+}
 
-    /* 检查key是否已存在，如存在则标记旧记录为已删除 */
-    uint32_t old_offset;
-    if (kv_hash_get(&g_hash_table, key, key_len, &old_offset) == 0) {
-        /* 读取旧记录并标记为已删除 */
-        uint32_t region_addr = handle->region_addr[handle->active_region];
-        kv_record_t old_record;
-        if (handle->ops->read(region_addr + old_offset, (uint8_t *)&old_record,
-                             sizeof(old_record)) == 0) {
-            old_record.flags = 2;  /* DELETED */
-            old_record.crc16 = kv_crc16((const uint8_t *)&old_record,
-                                        sizeof(kv_record_t) - 2);
-            handle->ops->write(region_addr + old_offset, (const uint8_t *)&old_record,
-                             sizeof(old_record));
-        }
+/* 构造记录：填写头部、复制key/value，填充字节保持0xFF；序号和CRC在追加时填写 */
+static void kv_record_build(kv_record_t *record, uint8_t flags,
+                            const uint8_t *key, uint8_t key_len,
+                            const uint8_t *value, uint8_t value_len)
+{
+    memset(record, 0xFF, KV_RECORD_SIZE(key_len, value_len));
+    record->header.magic = KV_RECORD_MAGIC;
+    record->header.flags = (uint8_t)~flags;
+    record->header.key_len = key_len;
+    record->header.value_len = value_len;
+    memcpy(record->data, key, key_len);
+    if (value_len > 0) {
+        memcpy(record->data + key_len, value, value_len);
     }
+}
 
-    /* 检查空间 */
-    uint32_t region_addr = handle->region_addr[handle->active_region];
-    uint32_t reserve_offset = region_addr + handle->region_size - handle->block_size;
-    uint32_t write_offset = region_addr + sizeof(kv_region_header_t) +
-                            handle->record_count * sizeof(kv_record_t);
-
-    if (write_offset >= reserve_offset) {
-        /* 空间不足，尝试GC */
-        int gc_ret = flash_kv_gc();
-        if (gc_ret != KV_OK) {
-            return KV_ERR_NO_SPACE;
-        }
-        /* 重新计算写入位置 */
-        write_offset = region_addr + sizeof(kv_region_header_t) +
-                      handle->record_count * sizeof(kv_record_t);
-        if (write_offset >= reserve_offset) {
-            return KV_ERR_NO_SPACE;
+/* 记录头部是否仍为擦除态 (日志只追加，第一个擦除头部即日志末尾) */
+static bool kv_record_is_erased(const kv_record_header_t *header)
+{
+    const uint8_t *p = (const uint8_t *)header;
+    for (uint32_t i = 0; i < sizeof(kv_record_header_t); i++) {
+        if (p[i] != 0xFF) {
+            return false;
         }
     }
-
-    /* 构造记录 */
-    kv_record_t record;
-    memset(&record, 0, sizeof(record));
-    memcpy(record.key, key, key_len);
-    memcpy(record.value, value, value_len);
-    record.key_len = key_len;
-    record.value_len = value_len;
-    record.flags = 1;  /* VALID */
-
-    /* 写入 */
-    int ret = kv_record_write(handle, write_offset, &record);
-    if (ret != 0) {
-        return KV_ERR_FLASH_FAIL;
-    }
-
-    /* 更新哈希表 */
-    kv_hash_set(&g_hash_table, key, key_len,
-                write_offset - region_addr);
-
-    handle->record_count++;
-    return KV_OK;
+    return true;
 }
 
-/* KV获取 */
-int flash_kv_get(const uint8_t *key, uint8_t key_len,
-                 uint8_t *value, uint8_t *value_len)
+/* 头部字段是否可信 (长度越界时无法确定下一条记录的位置)，只有提交标记没有key */
+static bool kv_record_header_sane(const kv_record_header_t *header)
 {
-    if (key == NULL || value == NULL || value_len == NULL) {
-        return KV_ERR_INVALID_PARAM;
-    }
-
-    kv_handle_t *handle = &g_handles[0];
-    if (handle->ops == NULL) {
-        return KV_ERR_NO_INIT;
-    }
-
-    /* 查找哈希表 */
-    uint32_t offset;
-    if (kv_hash_get(&g_hash_table, key, key_len, &offset) != 0) {
-        return KV_ERR_NOT_FOUND;
-    }
-
-    /* 读取记录 */
-    uint32_t region_addr = handle->region_addr[handle->active_region];
-    kv_record_t record;
-    if (handle->ops->read(region_addr + offset, (uint8_t *)&record,
-                         sizeof(record)) != 0) {
-        return KV_ERR_FLASH_FAIL;
-    }
+    return header->magic == KV_RECORD_MAGIC &&
+           (header->key_len != 0 || kv_record_is_commit(header)) &&
+           header->key_len <= FLASH_KV_KEY_SIZE &&
+           header->value_len <= FLASH_KV_VALUE_SIZE;
+}
 
-    /* 验证CRC */
-    if (kv_record_check_crc(&record) != 0) {
-        return KV_ERR_CRC_FAIL;
+/* 读取offset处的记录，一次读取最大记录长度 (不超出数据区末尾) */
+static int kv_record_read(const kv_handle_t *handle, uint32_t offset, kv_record_t *record)
+{
+    uint32_t len = KV_RECORD_MAX_SIZE;
+    if (offset + len > handle->total_size) {
+        len = handle->total_size - offset;
     }
-
-    /* 复制value - 先清零缓冲区防止乱码 */
-    memset(value, 0, FLASH_KV_VALUE_SIZE);
-    memcpy(value, record.value, record.value_len);
-    *value_len = record.value_len;
-
-    return KV_OK;
+    return handle->ops->read(handle->base_addr + offset, (uint8_t *)record, len);
 }
 
-/* KV删除 */
-int flash_kv_del(const uint8_t *key, uint8_t key_len)
+/* 内存映射的Flash中offset处记录的指针 (映射最大记录长度，不超出数据区末尾)，
+ * 不支持映射时返回NULL */
+static const kv_record_t *kv_record_map(const kv_handle_t *handle, uint32_t offset)
 {
-    if (key == NULL) {
-        return KV_ERR_INVALID_PARAM;
+    if (handle->ops->map == NULL) {
+        return NULL;
     }
-
-    kv_handle_t *handle = &g_handles[0];
-    if (handle->ops == NULL) {
-        return KV_ERR_NO_INIT;
+    uint32_t len = KV_RECORD_MAX_SIZE;
+    if (offset + len > handle->total_size) {
+        len = handle->total_size - offset;
     }
+    return (const kv_record_t *)handle->ops->map(handle->base_addr + offset, len);
+}
 
-    /* 先获取Flash中的偏移量，然后从哈希表删除 */
-    uint32_t offset;
-    if (kv_hash_get(&g_hash_table, key, key_len, &offset) != 0) {
-        return KV_ERR_NOT_FOUND;
+/* 指纹索引命中后读取记录，比对完整key */
+static bool kv_index_key_match(void *ctx, uint32_t offset,
+                               const uint8_t *key, uint8_t key_len)
+{
+    kv_handle_t *handle = (kv_handle_t *)ctx;
+    kv_record_key_t record;
+
+    /* 只需读取头部和key；调用者可能正在使用I/O缓冲，这里使用栈上的小缓冲 */
+    if (key_len == 0 || key_len > FLASH_KV_KEY_SIZE ||
+        handle->ops->read(handle->base_addr + offset, (uint8_t *)&record,
+                         sizeof(kv_record_header_t) + key_len) != 0) {
+        return false;
     }
+    return record.header.key_len == key_len &&
+           memcmp(record.key, key, key_len) == 0;
+}
 
-    /* 读取旧记录并标记为已删除 */
-    uint32_t region_addr = handle->region_addr[handle->active_region];
-    kv_record_t record;
-    if (handle->ops->read(region_addr + offset, (uint8_t *)&record,
-                         sizeof(record)) == 0) {
-        /* 标记为已删除 */
-        record.flags = 2;  /* DELETED */
-        record.crc16 = kv_crc16((const uint8_t *)&record,
-                                sizeof(kv_record_t) - 2);
-        handle->ops->write(region_addr + offset, (const uint8_t *)&record,
-                         sizeof(record));
+/* offset处记录占用的字节数，读取失败返回0 */
+static uint32_t kv_record_size_at(const kv_handle_t *handle, uint32_t offset)
+{
+    kv_record_header_t header;
+    if (handle->ops->read(handle->base_addr + offset, (uint8_t *)&header,
+                          sizeof(header)) != 0 ||
+        !kv_record_header_sane(&header)) {
+        return 0;
     }
-
-    /* 从哈希表删除 */
-    kv_hash_del(&g_hash_table, key, key_len);
-    handle->record_count--;
-
-    return KV_OK;
+    return KV_RECORD_SIZE(header.key_len, header.value_len);
 }
 
-/* KV是否存在 */
-bool flash_kv_exists(const uint8_t *key, uint8_t key_len)
+/* offset所在扇区 */
+static kv_sector_t *kv_sector_of(kv_handle_t *handle, uint32_t offset)
 {
-    uint32_t offset;
-    return (kv_hash_get(&g_hash_table, key, key_len, &offset) == 0);
+    return &handle->sectors[offset / handle->block_size];
 }
 
-/* 事务接口 */
-int flash_kv_tx_begin(void)
+/* 清零有效/可回收字节统计 (全局和各扇区) */
+static void kv_space_reset(kv_handle_t *handle)
 {
-    kv_handle_t *handle = &g_handles[0];
-    if (handle->ops == NULL) {
-        return KV_ERR_NO_INIT;
+    handle->live_bytes = 0;
+    handle->dead_bytes = 0;
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        handle->sectors[i].live = 0;
     }
-
-    /* 保存当前事务状态 */
-    handle->tx_state = KV_TX_STATE_PREPARED;
-    g_tx_pending = 0;
-    memset(&g_tx_pending_record, 0, sizeof(g_tx_pending_record));
-
-    return KV_OK;
 }
 
-int flash_kv_tx_commit(void)
+/* offset处新写入的记录成为索引指向的有效记录 */
+static void kv_space_add(kv_handle_t *handle, uint32_t offset, uint32_t size)
 {
-    kv_handle_t *handle = &g_handles[0];
-
-    if (g_tx_pending) {
-        /* 写入挂起的记录 */
-        uint32_t region_addr = handle->region_addr[handle->active_region];
-        uint32_t write_offset = region_addr + sizeof(kv_region_header_t) +
-                                handle->record_count * sizeof(kv_record_t);
-
-        int ret = kv_record_write(handle, write_offset, &g_tx_pending_record);
-        if (ret != 0) {
-            handle->tx_state = KV_TX_STATE_IDLE;
-            g_tx_pending = 0;
-            return KV_ERR_FLASH_FAIL;
-        }
-
-        /* 更新哈希表 */
-        kv_hash_set(&g_hash_table, g_tx_pending_record.key,
-                   g_tx_pending_record.key_len,
-                   write_offset - region_addr);
-        handle->record_count++;
-        g_tx_pending = 0;
-    }
-
-    handle->tx_state = KV_TX_STATE_COMMITTED;
-    handle->tx_state = KV_TX_STATE_IDLE;
-    return KV_OK;
+    handle->live_bytes += size;
+    kv_sector_of(handle, offset)->live += size;
 }
 
-int flash_kv_tx_rollback(void)
+/* offset处记录的写入序号，读取失败返回0 */
+static uint32_t kv_record_seq_at(const kv_handle_t *handle, uint32_t offset)
 {
-    kv_handle_t *handle = &g_handles[0];
-    g_tx_pending = 0;
-    memset(&g_tx_pending_record, 0, sizeof(g_tx_pending_record));
-    handle->tx_state = KV_TX_STATE_IDLE;
-    return KV_OK;
+    kv_record_header_t header;
+    if (handle->ops->read(handle->base_addr + offset, (uint8_t *)&header,
+                          sizeof(header)) != 0) {
+        return 0;
+    }
+    return header.seq;
 }
 
-/* GC接口 - 垃圾回收 */
-int flash_kv_gc(void)
+/* 记录被新记录取代或删除，所占空间从有效转为可回收 */
+static void kv_space_retire(kv_handle_t *handle, uint32_t old_offset)
 {
-    kv_handle_t *handle = &g_handles[0];
-    if (handle->ops == NULL) {
-        return KV_ERR_NO_INIT;
+    if (old_offset == 0) {
+        return;
     }
+    kv_sector_t *sector = kv_sector_of(handle, old_offset);
+    uint32_t size = kv_record_size_at(handle, old_offset);
+    if (size > handle->live_bytes) {
+        size = handle->live_bytes;
+    }
+    handle->live_bytes -= size;
+    handle->dead_bytes += size;
+    sector->live = (sector->live > size) ? sector->live - size : 0;
+    kv_cache_move(handle, old_offset, 0);
+}
 
-    uint8_t active = handle->active_region;
-    uint8_t inactive = 1 - active;
-    uint32_t active_addr = handle->region_addr[active];
-    uint32_t inactive_addr = handle->region_addr[inactive];
+/* 从offset开始扫描一段连续的批量记录，直到提交标记或其他记录为止，run_end返回其后的位置。
+ * 提交标记的value是本批记录总长，由此得到本批第一条记录的位置并返回；没有提交标记
+ * (写入中途掉电) 或本批中有损坏记录时返回end，整段都不生效。同一段中提交标记之前的
+ * 记录属于掉电前未提交的另一批 */
+static uint32_t kv_batch_scan(const kv_handle_t *handle, uint32_t offset, uint32_t end,
+                              uint32_t *run_end)
+{
+    kv_record_t *record = (kv_record_t *)handle->io_buf;
+    uint32_t bad_end = 0;
 
-    /* 擦除备用区域 */
-    if (handle->ops->erase(inactive_addr, handle->region_size) != 0) {
-        return KV_ERR_FLASH_FAIL;
+    while (offset + sizeof(kv_record_header_t) <= end) {
+        if (kv_record_read(handle, offset, record) != 0 ||
+            kv_record_is_erased(&record->header)) {
+            break;
+        }
+        uint32_t size = KV_RECORD_SIZE(record->header.key_len, record->header.value_len);
+        if (!kv_record_header_sane(&record->header) || offset + size > end ||
+            (!kv_record_is_batch(&record->header) && !kv_record_is_commit(&record->header))) {
+            break;
+        }
+        if (kv_record_check_crc(record) != 0) {
+            bad_end = offset + size;
+        } else if (kv_record_is_commit(&record->header)) {
+            uint32_t batch_len;
+            memcpy(&batch_len, record->data, sizeof(batch_len));
+            *run_end = offset + size;
+            return (batch_len <= offset && offset - batch_len >= bad_end) ?
+                   offset - batch_len : end;
+        }
+        offset += size;
     }
+    *run_end = offset;
+    return end;
+}
 
-    /* 扫描当前区域的有效记录 */
-    uint32_t offset = sizeof(kv_region_header_t);
-    uint32_t write_offset = sizeof(kv_region_header_t);
-    kv_record_t record;
-    uint32_t new_record_count = 0;
-
-    /* 重建临时哈希表 */
-    kv_hash_table_t new_hash_table;
-    kv_hash_init(&new_hash_table);
+/* 回放扇区内[offset, end)的记录，返回该扇区的日志末尾 (第一个擦除头部) */
+static uint32_t kv_sector_replay(kv_handle_t *handle, uint32_t offset, uint32_t end)
+{
+    kv_record_t *record = (kv_record_t *)handle->io_buf;
+    uint32_t run_end = offset;      /* 已扫描过的批量记录段末尾 */
+    uint32_t batch_start = end;     /* 该段中已提交的一批记录的起始位置 */
 
-    while (offset < handle->region_size - handle->block_size) {
-        if (handle->ops->read(active_addr + offset, (uint8_t *)&record,
-                             sizeof(record)) != 0) {
+    while (offset + sizeof(kv_record_header_t) <= end) {
+        if (kv_record_read(handle, offset, record) != 0 ||
+            kv_record_is_erased(&record->header)) {
             break;
         }
 
-        /* 检查CRC有效性且flags=1(VALID) */
-        if (kv_record_check_crc(&record) == 0 && record.flags == 1) {
-            /* 复制有效记录到备用区域 - 使用kv_record_write来重新计算CRC */
-            if (kv_record_write(handle, inactive_addr + write_offset, &record) != 0) {
-                return KV_ERR_FLASH_FAIL;
+        /* 头部损坏 (记录不会跨越扇区) 时按写入单位前进，寻找下一条记录 */
+        uint32_t size = KV_RECORD_SIZE(record->header.key_len, record->header.value_len);
+        if (!kv_record_header_sane(&record->header) || offset + size > end) {
+            handle->dead_bytes += FLASH_KV_WRITE_SIZE;
+            offset += FLASH_KV_WRITE_SIZE;
+            continue;
+        }
+
+        /* 冷数据流中GC搬移的记录保留原序号，与热数据流中的记录比较序号，
+         * 序号较大的生效 (相同时为同一记录的副本，取后回放的) */
+        uint32_t old_offset = 0;
+        uint32_t seq = record->header.seq;
+        if (kv_record_check_crc(record) != 0) {
+            handle->dead_bytes += size;
+        } else {
+            /* 批量记录所在的一段先向后扫描到提交标记，再重新读出当前记录；
+             * 未提交的批量记录和提交标记本身计为可回收 */
+            bool skip = false;
+            if (kv_record_is_batch(&record->header) || kv_record_is_commit(&record->header)) {
+                if (offset >= run_end) {
+                    batch_start = kv_batch_scan(handle, offset, end, &run_end);
+                    if (kv_record_read(handle, offset, record) != 0) {
+                        break;
+                    }
+                }
+                skip = kv_record_is_commit(&record->header) || offset < batch_start;
             }
 
-            /* 更新临时哈希表 - 使用新的偏移量 */
-            kv_hash_set(&new_hash_table, record.key, record.key_len,
-                       write_offset);
-            write_offset += sizeof(kv_record_t);
-            new_record_count++;
+            if (skip) {
+                handle->dead_bytes += size;
+            } else if (kv_record_is_tombstone(&record->header)) {
+                if (kv_hash_get(&handle->index, record->data, record->header.key_len,
+                                &old_offset) == 0 &&
+                    kv_record_seq_at(handle, old_offset) <= seq) {
+                    kv_hash_del(&handle->index, record->data, record->header.key_len, NULL);
+                } else {
+                    old_offset = 0;
+                }
+                handle->dead_bytes += size;
+            } else if (kv_hash_set(&handle->index, record->data, record->header.key_len,
+                                   offset, &old_offset) != 0) {
+                handle->dead_bytes += size;
+            } else if (old_offset != 0 && kv_record_seq_at(handle, old_offset) > seq) {
+                kv_hash_set(&handle->index, record->data, record->header.key_len,
+                            old_offset, NULL);
+                handle->dead_bytes += size;
+                old_offset = 0;
+            } else {
+                kv_space_add(handle, offset, size);
+            }
+            kv_space_retire(handle, old_offset);
+            if (record->header.seq >= handle->next_seq) {
+                handle->next_seq = record->header.seq + 1;
+            }
         }
-        offset += sizeof(kv_record_t);
+        handle->ckpt_writes++;
+        offset += size;
     }
+    return (offset < end) ? offset : end;
+}
 
-    /* 切换活跃区域 */
-    handle->active_region = inactive;
-    handle->record_count = new_record_count;
-
-    /* 替换哈希表 */
-    memcpy(&g_hash_table, &new_hash_table, sizeof(kv_hash_table_t));
-
-    return KV_OK;
+/* 从扇区idx的offset处开始，按扇区序号回放idx所在的流直到其末尾，并确定该流的
+ * 追加扇区和追加位置；已关闭扇区末尾未写的空间不再使用，计为可回收 */
+static void kv_log_replay(kv_handle_t *handle, uint32_t idx, uint32_t offset)
+{
+    for (;;) {
+        uint32_t end = kv_sector_start(handle, idx) + handle->block_size;
+        uint32_t log_end = kv_sector_replay(handle, offset, end);
+        int next = kv_sector_after(handle, idx);
+
+        if (next < 0 && handle->sectors[idx].cold) {
+            handle->cold_sector = idx;
+            handle->cold_offset = log_end;
+            return;
+        }
+        if (next < 0) {
+            handle->head_sector = idx;
+            handle->write_offset = log_end;
+            return;
+        }
+        handle->dead_bytes += end - log_end;
+        idx = (uint32_t)next;
+        offset = kv_sector_start(handle, idx) + sizeof(kv_sector_header_t);
+    }
 }
 
-uint8_t flash_kv_free_percent(void)
+/* 回放整个冷数据流，没有冷数据扇区时清除冷数据头 */
+static void kv_log_replay_cold(kv_handle_t *handle)
 {
-    kv_handle_t *handle = &g_handles[0];
-    uint32_t used = handle->record_count * sizeof(kv_record_t);
-    uint32_t total = handle->region_size - handle->block_size - sizeof(kv_region_header_t);
-    if (total == 0) return 0;
-    return (uint8_t)((total - used) * 100 / total);
+    int first = kv_sector_first(handle, true);
+
+    handle->cold_sector = KV_SECTOR_NONE;
+    if (first >= 0) {
+        kv_log_replay(handle, (uint32_t)first,
+                      kv_sector_start(handle, (uint32_t)first) + sizeof(kv_sector_header_t));
+    }
 }
 
-/* 批量操作接口 - 简化实现 */
-int flash_kv_foreach(kv_foreach_cb callback, void *user_data)
+/* 先回放热数据流，再回放冷数据流：删除标记只写入冷数据流，被它遮蔽的旧记录
+ * 要么在热数据流中，要么在冷数据流中位于它之前 (GC只搬移当时有效的记录) */
+static void kv_log_replay_all(kv_handle_t *handle)
 {
-    (void)callback;
-    (void)user_data;
-    return KV_ERR_NOT_FOUND;
+    uint32_t first = (uint32_t)kv_sector_first(handle, false);
+    kv_log_replay(handle, first, kv_sector_start(handle, first) + sizeof(kv_sector_header_t));
+    kv_log_replay_cold(handle);
 }
 
-int flash_kv_clear(void)
+/* 清空索引并回放整个日志恢复 (索引与日志不一致时)，序号不回退 */
+static void kv_index_recover(kv_handle_t *handle)
 {
-    kv_handle_t *handle = &g_handles[0];
+    uint32_t next_seq = handle->next_seq;
 
-    /* 擦除当前活跃区域 */
-    if (handle->ops && handle->ops->erase) {
-        handle->ops->erase(handle->region_addr[handle->active_region],
-                          handle->region_size);
+    kv_hash_clear(&handle->index);
+    kv_space_reset(handle);
+    kv_log_replay_all(handle);
+    if (handle->next_seq < next_seq) {
+        handle->next_seq = next_seq;
     }
-
-    /* 清除内存中的哈希表和计数 */
-    kv_hash_init(&g_hash_table);
-    handle->record_count = 0;
-
-    return KV_OK;
+    handle->record_count = handle->index.count;
 }
 
-uint32_t flash_kv_count(void)
+/* 日志已占用的字节数：两个追加扇区按已写部分计算，其余在它们之前打开的扇区
+ * 按写满计算 (末尾空隙不再使用) */
+static uint32_t kv_log_used(const kv_handle_t *handle)
 {
-    return g_handles[0].record_count;
+    uint32_t max_seq = handle->sectors[handle->head_sector].seq;
+    uint32_t used = handle->write_offset - kv_sector_start(handle, handle->head_sector) -
+                    sizeof(kv_sector_header_t);
+
+    if (handle->cold_sector != KV_SECTOR_NONE) {
+        used += handle->cold_offset - kv_sector_start(handle, handle->cold_sector) -
+                sizeof(kv_sector_header_t);
+        if (handle->sectors[handle->cold_sector].seq > max_seq) {
+            max_seq = handle->sectors[handle->cold_sector].seq;
+        }
+    }
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        if (handle->sectors[i].seq != KV_SECTOR_FREE && handle->sectors[i].seq < max_seq &&
+            !kv_sector_is_head(handle, i)) {
+            used += kv_sector_payload(handle);
+        }
+    }
+    return used;
+}
+
+/* 重建哈希表 - 优先加载索引快照，否则从最旧的扇区回放 */
+static void kv_hash_rebuild(kv_handle_t *handle)
+{
+    kv_hash_clear(&handle->index);
+    handle->next_seq = 0;
+    kv_space_reset(handle);
+    handle->ckpt_writes = 0;
+
+    /* 快照给出两个流的追加位置和各扇区有效字节，只回放其后的记录，同样先热后冷 */
+    if (kv_checkpoint_load(handle, &handle->index) == 0) {
+        uint32_t used = kv_log_used(handle);
+        handle->dead_bytes = (used > handle->live_bytes) ? used - handle->live_bytes : 0;
+        kv_log_replay(handle, handle->head_sector, handle->write_offset);
+        if (handle->cold_sector != KV_SECTOR_NONE) {
+            kv_log_replay(handle, handle->cold_sector, handle->cold_offset);
+        } else {
+            kv_log_replay_cold(handle);
+        }
+    } else {
+        kv_hash_clear(&handle->index);
+        handle->next_seq = 0;
+        kv_space_reset(handle);
+        kv_log_replay_all(handle);
+    }
+    handle->record_count = handle->index.count;
+
+    /* 回放的记录较多时立即保存快照，缩短下次启动 */
+    if (kv_checkpoint_due(handle)) {
+        kv_checkpoint_save(handle, &handle->index);
+    }
+}
+
+/* 热数据或冷数据流追加扇区的剩余字节，还没有冷数据流时为0 */
+static uint32_t kv_head_room(const kv_handle_t *handle, bool cold)
+{
+    if (!cold) {
+        return kv_sector_start(handle, handle->head_sector) + handle->block_size -
+               handle->write_offset;
+    }
+    if (handle->cold_sector == KV_SECTOR_NONE) {
+        return 0;
+    }
+    return kv_sector_start(handle, handle->cold_sector) + handle->block_size -
+           handle->cold_offset;
+}
+
+/* 追加扇区已写部分中的可回收字节 */
+static uint32_t kv_head_dead(const kv_handle_t *handle, bool cold)
+{
+    uint32_t idx = cold ? handle->cold_sector : handle->head_sector;
+    if (idx == KV_SECTOR_NONE) {
+        return 0;
+    }
+    uint32_t used = kv_sector_payload(handle) - kv_head_room(handle, cold);
+    return (used > handle->sectors[idx].live) ? used - handle->sectors[idx].live : 0;
+}
+
+/* 可存放有效记录的字节数：一个扇区留给GC搬移，热数据和冷数据两个追加扇区作为余量，
+ * 每个扇区末尾可能剩下放不下记录的空隙 */
+static uint32_t kv_log_capacity(const kv_handle_t *handle)
+{
+    return (handle->sector_count - 3) *
+           (kv_sector_payload(handle) - KV_RECORD_MAX_SIZE + FLASH_KV_WRITE_SIZE);
+}
+
+/* 不动用留给GC的扇区时还能追加的字节数 */
+static uint32_t kv_log_free(const kv_handle_t *handle)
+{
+    uint32_t spare = (handle->free_sectors > 1) ? handle->free_sectors - 1 : 0;
+    return kv_head_room(handle, false) + spare * kv_sector_payload(handle);
+}
+
+/* 关闭流的追加扇区，打开日志头之后的下一个空闲扇区；原扇区剩余空间计为可回收 */
+static int kv_log_advance(kv_handle_t *handle, bool cold)
+{
+    uint32_t room = kv_head_room(handle, cold);
+    int idx = kv_sector_next_free(handle);
+
+    if (idx < 0 || kv_sector_open(handle, (uint32_t)idx, cold) != 0) {
+        return -1;
+    }
+    handle->dead_bytes += room;
+    return 0;
+}
+
+/* 在热数据或冷数据流的追加位置一次写入size字节 (一条或连续多条记录)，返回写入的偏移；
+ * 追加扇区放不下时先打开下一个扇区 */
+static int kv_log_program(kv_handle_t *handle, bool cold, const uint8_t *data, uint32_t size,
+                          uint32_t *offset)
+{
+    if (kv_head_room(handle, cold) < size && kv_log_advance(handle, cold) != 0) {
+        return -1;
+    }
+
+    uint32_t *pos = cold ? &handle->cold_offset : &handle->write_offset;
+    *offset = *pos;
+    if (handle->ops->write(handle->base_addr + *offset, data, size) == 0) {
+        *pos += size;
+        return 0;
+    }
+
+    /* 写失败时已部分编程的记录跳过，从第一条头部仍为擦除态的记录处继续追加；
+     * 否则日志中间出现擦除头部，启动扫描会提前结束 */
+    uint32_t done = 0;
+    while (done < size) {
+        kv_record_header_t check;
+        if (handle->ops->read(handle->base_addr + *offset + done, (uint8_t *)&check,
+                              sizeof(check)) != 0) {
+            done = size;
+            break;
+        }
+        if (kv_record_is_erased(&check)) {
+            break;
+        }
+        const kv_record_header_t *header = (const kv_record_header_t *)(data + done);
+        done += KV_RECORD_SIZE(header->key_len, header->value_len);
+    }
+    *pos += done;
+    handle->dead_bytes += done;
+    return -1;
+}
+
+/* 在热数据或冷数据流追加一条已填好序号和CRC的记录，返回其数据区内偏移 */
+static int kv_log_write(kv_handle_t *handle, bool cold, const kv_record_t *record,
+                        uint32_t *offset)
+{
+    return kv_log_program(handle, cold, (const uint8_t *)record,
+                          KV_RECORD_SIZE(record->header.key_len, record->header.value_len),
+                          offset);
+}
+
+/* 分配序号、计算CRC后追加记录 */
+static int kv_record_append(kv_handle_t *handle, bool cold, kv_record_t *record,
+                            uint32_t *offset)
+{
+    record->header.seq = handle->next_seq++;
+    record->header.crc16 = kv_record_crc(record);
+    return kv_log_write(handle, cold, record, offset);
+}
+
+/* 本次写入需推进的GC步数：回收扇区的剩余工作量按可用空间分摊到之后的写入，
+ * 使回收在空闲扇区用完前完成 (待扫描记录数按最短记录估计，偏多) */
+static uint32_t kv_gc_pace(const kv_handle_t *handle, uint32_t size)
+{
+    uint32_t room = kv_log_free(handle);
+    if (room <= size) {
+        return UINT32_MAX;
+    }
+
+    uint32_t victim_end = kv_sector_start(handle, handle->gc_victim) + handle->block_size;
+    uint32_t scan_left = (handle->gc_state == KV_GC_COPY) ?
+        (victim_end - handle->gc_scan_offset) / KV_RECORD_SIZE(1, 0) + 1 : 0;
+    uint64_t steps = (uint64_t)(scan_left + 1) * size / (room - size) + 1;
+
+    if (steps < FLASH_KV_GC_STEP_BUDGET) {
+        return FLASH_KV_GC_STEP_BUDGET;
+    }
+    return (steps > UINT32_MAX) ? UINT32_MAX : (uint32_t)steps;
+}
+
+/* 回收一个扇区：完成进行中的回收，否则同步回收收益最高的扇区 */
+static int kv_gc_reclaim(kv_handle_t *handle)
+{
+    if (handle->gc_state == KV_GC_IDLE && kv_gc_start(handle, handle->sector_seq, 1) != 0) {
+        return KV_ERR_NO_SPACE;
+    }
+
+    int ret;
+    do {
+        ret = flash_kv_gc_step_h(handle, UINT32_MAX);
+    } while (ret == KV_GC_PENDING);
+    return ret;
+}
+
+/* 确保热数据或冷数据流还能追加size字节，其中grow字节将成为有效记录 (删除标记为0)：
+ * GC进行中时按进度推进若干步；需要新扇区而空闲扇区只剩留给GC的一个时，
+ * 同步回收一个扇区 (每次只搬移一个扇区) */
+static int kv_log_reserve(kv_handle_t *handle, bool cold, uint32_t size, uint32_t grow)
+{
+    /* 有效记录超出容量时搬移也腾不出空间，直接拒绝，不做无用的擦写 */
+    if (handle->live_bytes + grow > kv_log_capacity(handle)) {
+        return KV_ERR_NO_SPACE;
+    }
+
+    /* 搬移已用到最后一个空闲扇区时先完成本轮，日志头剩余空间留给搬移；
+     * 回收失败时已放弃本轮，日志仍然有效，继续按空闲扇区判断 */
+    if (handle->gc_state != KV_GC_IDLE) {
+        flash_kv_gc_step_h(handle, (handle->free_sectors == 0) ? UINT32_MAX :
+                                   kv_gc_pace(handle, size));
+    }
+    if (kv_head_room(handle, cold) >= size) {
+        return KV_OK;
+    }
+
+    for (uint32_t i = 0; handle->free_sectors <= 1; i++) {
+        if (i >= handle->sector_count || kv_gc_reclaim(handle) != KV_OK) {
+            return KV_ERR_NO_SPACE;
+        }
+        if (kv_head_room(handle, cold) >= size) {
+            return KV_OK;
+        }
+    }
+    if (kv_log_advance(handle, cold) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    /* 空闲空间降到阈值以下时开始增量回收，之后的写入分摊搬移工作 */
+    if (handle->gc_state == KV_GC_IDLE && kv_gc_wanted(handle)) {
+        kv_gc_start(handle, handle->sector_seq, 1);
+    }
+    return KV_OK;
+}
+
+/* 事务中的写入暂存到事务暂存区，提交时整批写入；整批连同提交标记须能放进一个扇区 */
+static int kv_tx_stage(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                       const uint8_t *value, uint8_t value_len)
+{
+    uint32_t size = KV_RECORD_SIZE(key_len, value_len);
+    uint32_t total = handle->tx_used + size + KV_COMMIT_SIZE;
+
+    if (total > handle->tx_size || total > kv_sector_payload(handle)) {
+        return KV_ERR_TRANSACTION;
+    }
+
+    kv_record_t *record = (kv_record_t *)handle->io_buf;
+    kv_record_build(record, KV_RECORD_FLAG_BATCH, key, key_len, value, value_len);
+    memcpy(handle->tx_buf + handle->tx_used, record, size);
+    handle->tx_used += size;
+    return KV_OK;
+}
+
+/* 把len字节的value复制到调用者缓冲区，*value_len输入缓冲区大小、返回实际长度；
+ * 缓冲区放不下时不复制，返回KV_ERR_BUF_TOO_SMALL。value之后的字节清零防止乱码
+ * (不超过缓冲区大小和最大value长度) */
+static int kv_value_copy(uint8_t *value, uint8_t *value_len, const uint8_t *src, uint8_t len)
+{
+    uint8_t capacity = *value_len;
+
+    *value_len = len;
+    if (len > capacity) {
+        return KV_ERR_BUF_TOO_SMALL;
+    }
+    memcpy(value, src, len);
+    if (capacity > FLASH_KV_VALUE_SIZE) {
+        capacity = FLASH_KV_VALUE_SIZE;
+    }
+    if (capacity > len) {
+        memset(value + len, 0, capacity - len);
+    }
+    return KV_OK;
+}
+
+/* 读取offset处记录的value：值缓存命中时不读取Flash，否则读取并校验后放入缓存；
+ * *value_len输入缓冲区大小 */
+static int kv_value_read(kv_handle_t *handle, uint32_t offset,
+                         uint8_t *value, uint8_t *value_len)
+{
+    uint8_t len;
+    const uint8_t *cached = kv_cache_get(handle, offset, &len);
+    if (cached != NULL) {
+        return kv_value_copy(value, value_len, cached, len);
+    }
+
+    /* 内存映射的Flash直接校验映射的记录，否则读入I/O缓冲 */
+    const kv_record_t *record = kv_record_map(handle, offset);
+    if (record == NULL) {
+        record = (const kv_record_t *)handle->io_buf;
+        if (kv_record_read(handle, offset, (kv_record_t *)handle->io_buf) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+    }
+
+    /* 验证CRC */
+    if (!kv_record_header_sane(&record->header) || kv_record_check_crc(record) != 0) {
+        return KV_ERR_CRC_FAIL;
+    }
+
+    const uint8_t *stored = record->data + record->header.key_len;
+    kv_cache_put(handle, offset, stored, record->header.value_len);
+    return kv_value_copy(value, value_len, stored, record->header.value_len);
+}
+
+/*============================================================================
+ * 写回缓冲：写回模式下set先缓冲在RAM中，同一key的多次写入合并为一条记录，
+ * 到期 (flash_kv_poll) 或flash_kv_flush时整组写入
+ *============================================================================*/
+
+/* 写回时一次交给批量写入的条目数 */
+#define KV_FLUSH_BATCH  8
+
+static kv_dirty_entry_t *kv_dirty_find(kv_handle_t *handle, const uint8_t *key, uint8_t key_len)
+{
+    for (uint32_t i = 0; i < handle->dirty_entries; i++) {
+        kv_dirty_entry_t *entry = &handle->dirty[i];
+        if (entry->key_len != 0 && entry->key_len == key_len &&
+            memcmp(entry->key, key, key_len) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* 取一个空条目，缓冲已满返回NULL */
+static kv_dirty_entry_t *kv_dirty_alloc(kv_handle_t *handle)
+{
+    for (uint32_t i = 0; i < handle->dirty_entries; i++) {
+        if (handle->dirty[i].key_len == 0) {
+            handle->dirty_count++;
+            return &handle->dirty[i];
+        }
+    }
+    return NULL;
+}
+
+static void kv_dirty_release(kv_handle_t *handle, kv_dirty_entry_t *entry)
+{
+    entry->key_len = 0;
+    handle->dirty_count--;
+}
+
+/* 缓冲中不在索引里的key数 (写入后新增的索引槽) */
+static uint32_t kv_dirty_new_keys(kv_handle_t *handle)
+{
+    uint32_t count = 0;
+    uint32_t offset;
+
+    for (uint32_t i = 0; i < handle->dirty_entries && count < handle->dirty_count; i++) {
+        const kv_dirty_entry_t *entry = &handle->dirty[i];
+        if (entry->key_len != 0 &&
+            kv_hash_get(&handle->index, entry->key, entry->key_len, &offset) != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* key在Flash中的值是否已经是value */
+static bool kv_value_stored(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                            const uint8_t *value, uint8_t value_len)
+{
+    uint8_t stored[FLASH_KV_VALUE_SIZE];
+    uint8_t stored_len = sizeof(stored);
+    uint32_t offset;
+
+    return kv_hash_get(&handle->index, key, key_len, &offset) == 0 &&
+           kv_value_read(handle, offset, stored, &stored_len) == KV_OK &&
+           stored_len == value_len && memcmp(stored, value, value_len) == 0;
+}
+
+/* 写入缓冲的值 (all为false时只写入超过延迟的)，与Flash中相同的值直接丢弃；
+ * 写入成功的条目释放，失败的留在缓冲中 */
+static int kv_dirty_flush(kv_handle_t *handle, bool all)
+{
+    int ret = KV_OK;
+
+    for (uint32_t i = 0; i < handle->dirty_entries && ret == KV_OK; ) {
+        kv_item_t items[KV_FLUSH_BATCH];
+        kv_dirty_entry_t *owners[KV_FLUSH_BATCH];
+        uint32_t n = 0;
+
+        for (; i < handle->dirty_entries && n < KV_FLUSH_BATCH; i++) {
+            kv_dirty_entry_t *entry = &handle->dirty[i];
+            if (entry->key_len == 0 ||
+                (!all && handle->wb_now - entry->since < handle->wb_delay)) {
+                continue;
+            }
+            if (kv_value_stored(handle, entry->key, entry->key_len,
+                                entry->value, entry->value_len)) {
+                kv_dirty_release(handle, entry);
+                continue;
+            }
+            items[n].key = entry->key;
+            items[n].key_len = entry->key_len;
+            items[n].value = entry->value;
+            items[n].value_len = entry->value_len;
+            owners[n++] = entry;
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        ret = kv_mset_log(handle, items, n);
+        for (uint32_t k = 0; k < n; k++) {
+            if (items[k].result == KV_OK) {
+                kv_dirty_release(handle, owners[k]);
+            }
+        }
+    }
+    return ret;
+}
+
+/* 写回模式的set：已缓冲的key原地更新；新key的值与Flash中相同时不缓冲，
+ * 缓冲已满时先写入全部缓冲的值 */
+static int kv_dirty_set(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                        const uint8_t *value, uint8_t value_len)
+{
+    kv_dirty_entry_t *entry = kv_dirty_find(handle, key, key_len);
+
+    if (entry == NULL) {
+        if (kv_value_stored(handle, key, key_len, value, value_len)) {
+            return KV_OK;
+        }
+
+        /* 索引已满时只能更新已有key */
+        uint32_t offset;
+        if (kv_hash_get(&handle->index, key, key_len, &offset) != 0 &&
+            kv_hash_reserve(&handle->index, kv_dirty_new_keys(handle) + 1) != 0) {
+            return KV_ERR_HASH_FULL;
+        }
+
+        entry = kv_dirty_alloc(handle);
+        if (entry == NULL) {
+            int ret = kv_dirty_flush(handle, true);
+            if (ret != KV_OK) {
+                return ret;
+            }
+            entry = kv_dirty_alloc(handle);
+        }
+        entry->key_len = key_len;
+        memcpy(entry->key, key, key_len);
+        entry->since = handle->wb_now;
+    }
+
+    entry->value_len = value_len;
+    memcpy(entry->value, value, value_len);
+    return KV_OK;
+}
+
+int flash_kv_poll_h(kv_handle_t *handle, uint32_t now)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    handle->wb_now = now;
+    int ret = kv_dirty_flush(handle, false);
+    return (ret != KV_OK) ? ret : (int)handle->dirty_count;
+}
+
+int flash_kv_flush_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    return kv_dirty_flush(handle, true);
+}
+
+/* key的哈希，供_hashed接口使用 (可在主机上预先算好) */
+uint32_t flash_kv_key_hash(const uint8_t *key, uint8_t key_len)
+{
+    return (key != NULL) ? kv_hash_key(key, key_len) : 0;
+}
+
+/* KV设置 */
+int flash_kv_set_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                 const uint8_t *value, uint8_t value_len)
+{
+    return flash_kv_set_hashed_h(handle, key, key_len, flash_kv_key_hash(key, key_len),
+                                 value, value_len);
+}
+
+int flash_kv_set_hashed_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                          uint32_t hash, const uint8_t *value, uint8_t value_len)
+{
+    if (!kv_key_valid(key, key_len) || value == NULL || value_len > FLASH_KV_VALUE_SIZE) {
+        return KV_ERR_INVALID_PARAM;
+    }
+
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    if (handle->tx_state == KV_TX_STATE_PREPARED) {
+        return kv_tx_stage(handle, key, key_len, value, value_len);
+    }
+    if (handle->wb_delay != 0) {
+        return kv_dirty_set(handle, key, key_len, value, value_len);
+    }
+
+    /* 索引已满时只能更新已有key */
+    uint32_t old_offset;
+    if (kv_hash_reserve(&handle->index, 1) != 0 &&
+        kv_hash_get_hashed(&handle->index, hash, key, key_len, &old_offset) != 0) {
+        return KV_ERR_HASH_FULL;
+    }
+
+    /* 检查空间 */
+    int ret = kv_log_reserve(handle, false, KV_RECORD_SIZE(key_len, value_len),
+                             KV_RECORD_SIZE(key_len, value_len));
+    if (ret != KV_OK) {
+        return ret;
+    }
+
+    /* 构造记录并写入，旧记录保持不变，由序号更大的新记录取代 */
+    kv_record_t *record = (kv_record_t *)handle->io_buf;
+    kv_record_build(record, 0, key, key_len, value, value_len);
+    uint32_t write_offset;
+    if (kv_record_append(handle, false, record, &write_offset) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    /* 更新哈希表，旧记录转为可回收空间 */
+    kv_hash_set_hashed(&handle->index, hash, key, key_len, write_offset, &old_offset);
+    kv_space_add(handle, write_offset, KV_RECORD_SIZE(key_len, value_len));
+    kv_space_retire(handle, old_offset);
+
+    handle->record_count = handle->index.count;
+    kv_checkpoint_tick(handle);
+    return KV_OK;
+}
+
+/* KV获取 */
+int flash_kv_get_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                 uint8_t *value, uint8_t *value_len)
+{
+    return flash_kv_get_hashed_h(handle, key, key_len, flash_kv_key_hash(key, key_len),
+                                 value, value_len);
+}
+
+int flash_kv_get_hashed_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                          uint32_t hash, uint8_t *value, uint8_t *value_len)
+{
+    if (!kv_key_valid(key, key_len) || value == NULL || value_len == NULL) {
+        return KV_ERR_INVALID_PARAM;
+    }
+
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    /* 写回缓冲中的值比Flash中的新 */
+    const kv_dirty_entry_t *entry = kv_dirty_find(handle, key, key_len);
+    if (entry != NULL) {
+        return kv_value_copy(value, value_len, entry->value, entry->value_len);
+    }
+
+    /* 查找哈希表 */
+    uint32_t offset;
+    if (kv_hash_get_hashed(&handle->index, hash, key, key_len, &offset) != 0) {
+        return KV_ERR_NOT_FOUND;
+    }
+    return kv_value_read(handle, offset, value, value_len);
+}
+
+/* KV零拷贝读取：返回映射Flash中value的指针，校验CRC但不复制 */
+int flash_kv_get_ref_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len, kv_ref_t *ref)
+{
+    if (!kv_key_valid(key, key_len) || ref == NULL) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    if (handle->ops->map == NULL) {
+        return KV_ERR_INVALID_PARAM;
+    }
+
+    /* 写回缓冲中的值还不在Flash中，先写入 */
+    if (kv_dirty_find(handle, key, key_len) != NULL) {
+        int ret = kv_dirty_flush(handle, true);
+        if (ret != KV_OK) {
+            return ret;
+        }
+    }
+
+    uint32_t offset;
+    if (kv_hash_get(&handle->index, key, key_len, &offset) != 0) {
+        return KV_ERR_NOT_FOUND;
+    }
+    const kv_record_t *record = kv_record_map(handle, offset);
+    if (record == NULL) {
+        return KV_ERR_FLASH_FAIL;
+    }
+    if (!kv_record_header_sane(&record->header) || kv_record_check_crc(record) != 0) {
+        return KV_ERR_CRC_FAIL;
+    }
+
+    ref->value = record->data + record->header.key_len;
+    ref->value_len = record->header.value_len;
+    ref->sector = offset / handle->block_size;
+    ref->generation = handle->sectors[ref->sector].erase_gen;
+    return KV_OK;
+}
+
+/* 引用取得后记录所在扇区没有擦除过，指向的记录仍在原位置；其他扇区的擦除不影响 */
+bool flash_kv_ref_valid_h(kv_handle_t *handle, const kv_ref_t *ref)
+{
+    return ref != NULL && kv_handle_ready(handle) && ref->sector < handle->sector_count &&
+           ref->generation == handle->sectors[ref->sector].erase_gen;
+}
+
+/* KV删除 */
+int flash_kv_del_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len)
+{
+    return flash_kv_del_hashed_h(handle, key, key_len, flash_kv_key_hash(key, key_len));
+}
+
+int flash_kv_del_hashed_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len,
+                          uint32_t hash)
+{
+    if (!kv_key_valid(key, key_len)) {
+        return KV_ERR_INVALID_PARAM;
+    }
+
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    /* 删除标记写入冷数据流，不能与热数据流中的批量记录一起提交 */
+    if (handle->tx_state == KV_TX_STATE_PREPARED) {
+        return KV_ERR_TRANSACTION;
+    }
+
+    /* 确认key存在；只在写回缓冲中的key丢弃缓冲的值，不需要写删除标记 */
+    kv_dirty_entry_t *entry = kv_dirty_find(handle, key, key_len);
+    uint32_t offset;
+    if (kv_hash_get_hashed(&handle->index, hash, key, key_len, &offset) != 0) {
+        if (entry == NULL) {
+            return KV_ERR_NOT_FOUND;
+        }
+        kv_dirty_release(handle, entry);
+        return KV_OK;
+    }
+
+    /* 删除标记追加到冷数据流 (回放时在热数据流之后，能遮蔽两个流中的旧记录)，
+     * 启动回放和快照之后的回放都能看到删除 */
+    int ret = kv_log_reserve(handle, true, KV_RECORD_SIZE(key_len, 0), 0);
+    if (ret != KV_OK) {
+        return ret;
+    }
+    kv_record_t *record = (kv_record_t *)handle->io_buf;
+    kv_record_build(record, KV_RECORD_FLAG_TOMBSTONE, key, key_len, NULL, 0);
+    uint32_t write_offset;
+    if (kv_record_append(handle, true, record, &write_offset) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    /* 删除标记写入后才丢弃写回缓冲中的值，写入失败时缓冲的新值仍然有效 */
+    if (entry != NULL) {
+        kv_dirty_release(handle, entry);
+    }
+
+    /* 腾空间时GC可能已搬移旧记录，按索引中的当前偏移计为可回收 */
+    kv_hash_del_hashed(&handle->index, hash, key, key_len, &offset);
+    handle->dead_bytes += KV_RECORD_SIZE(key_len, 0);
+    kv_space_retire(handle, offset);
+    handle->record_count = handle->index.count;
+    kv_checkpoint_tick(handle);
+    return KV_OK;
+}
+
+/* KV是否存在 */
+bool flash_kv_exists_h(kv_handle_t *handle, const uint8_t *key, uint8_t key_len)
+{
+    if (!kv_key_valid(key, key_len) || !kv_handle_ready(handle)) {
+        return false;
+    }
+
+    uint32_t offset;
+    return kv_dirty_find(handle, key, key_len) != NULL ||
+           kv_hash_get(&handle->index, key, key_len, &offset) == 0;
+}
+
+/* mget每轮在栈上按偏移排序的待读取条目数 */
+#define KV_MGET_BATCH  16
+
+/* 待读取条目的result暂存记录偏移加1 (大于0，数据区小于2GB)，
+ * 读取完成前不写调用者的value缓冲 */
+#define KV_ITEM_PENDING(offset)  ((int)(offset) + 1)
+
+/* 已查到偏移、等待读取的条目：记录偏移和条目下标 */
+typedef struct {
+    uint32_t offset;
+    uint32_t index;
+} kv_mget_slot_t;
+
+/* 批量读写条目的key和value缓冲是否有效 (value_len在mget中是输出，不检查) */
+static bool kv_item_valid(const kv_item_t *item)
+{
+    return kv_key_valid(item->key, item->key_len) && item->value != NULL;
+}
+
+/* 待读取记录可能占用的末尾位置 (按最大记录长度，不超出数据区末尾) */
+static uint32_t kv_mget_span_end(const kv_handle_t *handle, uint32_t offset)
+{
+    uint32_t end = offset + KV_RECORD_MAX_SIZE;
+    return (end > handle->total_size) ? handle->total_size : end;
+}
+
+/* 选出偏移最小的至多KV_MGET_BATCH个待读取条目，按偏移升序放入slots (插入排序)，
+ * 返回选出的条目数 */
+static uint32_t kv_mget_select(const kv_item_t *items, uint32_t count, kv_mget_slot_t *slots)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (items[i].result <= 0) {
+            continue;
+        }
+        uint32_t offset = (uint32_t)items[i].result - 1;
+        if (n == KV_MGET_BATCH && offset >= slots[n - 1].offset) {
+            continue;
+        }
+        uint32_t j = (n < KV_MGET_BATCH) ? n++ : n - 1;
+        while (j > 0 && slots[j - 1].offset > offset) {
+            slots[j] = slots[j - 1];
+            j--;
+        }
+        slots[j].offset = offset;
+        slots[j].index = i;
+    }
+    return n;
+}
+
+/* 按偏移从小到大分段读取选出的条目：每段读取I/O缓冲放得下的连续区域 (含其间的空隙)，
+ * 完成段内所有条目。批满时最后一段可能还有未选出的条目，留到下一轮与它们一起读取
+ * (第一段除外，保证每轮都有进展)。返回完成的条目数，found累加读取成功的条目数 */
+static uint32_t kv_mget_read(kv_handle_t *handle, kv_item_t *items,
+                             const kv_mget_slot_t *slots, uint32_t n, uint32_t *found)
+{
+    uint32_t first = 0;
+    while (first < n) {
+        uint32_t start = slots[first].offset;
+        uint32_t end = kv_mget_span_end(handle, start);
+        uint32_t last = first + 1;
+        while (last < n && kv_mget_span_end(handle, slots[last].offset) - start <= handle->io_size) {
+            end = kv_mget_span_end(handle, slots[last].offset);
+            last++;
+        }
+        if (last == KV_MGET_BATCH && first > 0) {
+            break;
+        }
+
+        /* 内存映射的Flash直接使用映射的一段，不复制 */
+        const uint8_t *window = (handle->ops->map != NULL) ?
+            handle->ops->map(handle->base_addr + start, end - start) : NULL;
+        int ret = 0;
+        if (window == NULL) {
+            window = handle->io_buf;
+            ret = handle->ops->read(handle->base_addr + start, handle->io_buf, end - start);
+        }
+        for (uint32_t i = first; i < last; i++) {
+            kv_item_t *item = &items[slots[i].index];
+            const kv_record_t *record = (const kv_record_t *)(window + slots[i].offset - start);
+            if (ret != 0) {
+                item->result = KV_ERR_FLASH_FAIL;
+            } else if (!kv_record_header_sane(&record->header) ||
+                       kv_record_check_crc(record) != 0) {
+                item->result = KV_ERR_CRC_FAIL;
+            } else {
+                memcpy(item->value, record->data + record->header.key_len,
+                       record->header.value_len);
+                item->value_len = record->header.value_len;
+                item->result = KV_OK;
+                kv_cache_put(handle, slots[i].offset, item->value, item->value_len);
+                (*found)++;
+            }
+        }
+        first = last;
+    }
+    return first;
+}
+
+/* KV批量读取：先查出所有key的记录偏移，再每轮选出偏移最小的一批，按偏移从小到大
+ * 分段顺序读取，相邻的小记录合并为一次大块读取，不必每个key单独读取一次 */
+int flash_kv_mget_h(kv_handle_t *handle, kv_item_t *items, uint32_t count)
+{
+    if (items == NULL && count > 0) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    uint32_t found = 0;
+    uint32_t pending = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t offset;
+        const kv_dirty_entry_t *entry;
+        const uint8_t *cached;
+        if (!kv_item_valid(&items[i])) {
+            items[i].result = KV_ERR_INVALID_PARAM;
+        } else if ((entry = kv_dirty_find(handle, items[i].key, items[i].key_len)) != NULL) {
+            memcpy(items[i].value, entry->value, entry->value_len);
+            items[i].value_len = entry->value_len;
+            items[i].result = KV_OK;
+            found++;
+        } else if (kv_hash_get(&handle->index, items[i].key, items[i].key_len, &offset) != 0) {
+            items[i].result = KV_ERR_NOT_FOUND;
+        } else if ((cached = kv_cache_get(handle, offset, &items[i].value_len)) != NULL) {
+            memcpy(items[i].value, cached, items[i].value_len);
+            items[i].result = KV_OK;
+            found++;
+        } else {
+            items[i].result = KV_ITEM_PENDING(offset);
+            pending++;
+        }
+    }
+
+    kv_mget_slot_t slots[KV_MGET_BATCH];
+    while (pending > 0) {
+        uint32_t n = kv_mget_select(items, count, slots);
+        pending -= kv_mget_read(handle, items, slots, n, &found);
+    }
+    return (int)found;
+}
+
+/* 把n个条目的记录依次构造在I/O缓冲中，一次编程写入日志头，再逐条更新索引 */
+static int kv_mset_write(kv_handle_t *handle, const kv_item_t *items, uint32_t n, uint32_t size)
+{
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        kv_record_t *record = (kv_record_t *)(handle->io_buf + pos);
+        kv_record_build(record, 0, items[i].key, items[i].key_len,
+                        items[i].value, items[i].value_len);
+        record->header.seq = handle->next_seq++;
+        record->header.crc16 = kv_record_crc(record);
+        pos += KV_RECORD_SIZE(items[i].key_len, items[i].value_len);
+    }
+
+    uint32_t write_offset;
+    if (kv_log_program(handle, false, handle->io_buf, size, &write_offset) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    pos = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t record_size = KV_RECORD_SIZE(items[i].key_len, items[i].value_len);
+        uint32_t old_offset;
+        kv_hash_set(&handle->index, items[i].key, items[i].key_len,
+                    write_offset + pos, &old_offset);
+        kv_space_add(handle, write_offset + pos, record_size);
+        kv_space_retire(handle, old_offset);
+        pos += record_size;
+    }
+
+    /* 快照间隔按记录条数计 */
+    handle->record_count = handle->index.count;
+    handle->ckpt_writes += n - 1;
+    kv_checkpoint_tick(handle);
+    return KV_OK;
+}
+
+/* 依次取出I/O缓冲和日志头扇区剩余空间放得下的一组条目，整组一次编程；
+ * 失败时该条目及之后的条目result为错误码 */
+static int kv_mset_log(kv_handle_t *handle, kv_item_t *items, uint32_t count)
+{
+    int ret = KV_OK;
+    uint32_t i = 0;
+    while (i < count) {
+        /* 日志头扇区放得下第一条时不打开新扇区，剩余空间多少就合并多少 */
+        uint32_t limit = kv_head_room(handle, false);
+        if (limit < KV_RECORD_SIZE(items[i].key_len, items[i].value_len)) {
+            limit = kv_sector_payload(handle);
+        }
+        if (limit > handle->io_size) {
+            limit = handle->io_size;
+        }
+
+        /* 新key数按上限计，索引将满时才查找确认 (索引已满时只能更新已有key) */
+        uint32_t size = 0;
+        uint32_t new_keys = 0;
+        uint32_t n = 0;
+        while (i + n < count) {
+            const kv_item_t *item = &items[i + n];
+            uint32_t record_size = KV_RECORD_SIZE(item->key_len, item->value_len);
+            uint32_t offset;
+            if (size + record_size > limit) {
+                break;
+            }
+            if (kv_hash_reserve(&handle->index, new_keys + 1) != 0) {
+                if (kv_hash_get(&handle->index, item->key, item->key_len, &offset) != 0) {
+                    break;
+                }
+            } else {
+                new_keys++;
+            }
+            size += record_size;
+            n++;
+        }
+        if (n == 0) {
+            ret = KV_ERR_HASH_FULL;
+            break;
+        }
+
+        /* 先预留空间 (可能推进GC，会用到I/O缓冲)，再构造记录 */
+        ret = kv_log_reserve(handle, false, size, size);
+        if (ret == KV_OK) {
+            ret = kv_mset_write(handle, &items[i], n, size);
+        }
+        if (ret != KV_OK) {
+            break;
+        }
+        for (uint32_t k = 0; k < n; k++) {
+            items[i + k].result = KV_OK;
+        }
+        i += n;
+    }
+
+    for (; i < count; i++) {
+        items[i].result = ret;
+    }
+    return ret;
+}
+
+
+/* KV批量写入：各条记录独立生效，不是原子写入 (需要原子性时在事务中调用，逐条暂存) */
+int flash_kv_mset_h(kv_handle_t *handle, kv_item_t *items, uint32_t count)
+{
+    if (items == NULL && count > 0) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!kv_item_valid(&items[i]) || items[i].value_len > FLASH_KV_VALUE_SIZE) {
+            items[i].result = KV_ERR_INVALID_PARAM;
+            return KV_ERR_INVALID_PARAM;
+        }
+    }
+
+    if (handle->tx_state == KV_TX_STATE_PREPARED) {
+        int ret = KV_OK;
+        for (uint32_t i = 0; i < count; i++) {
+            if (ret == KV_OK) {
+                ret = kv_tx_stage(handle, items[i].key, items[i].key_len,
+                                  items[i].value, items[i].value_len);
+            }
+            items[i].result = ret;
+        }
+        return ret;
+    }
+
+    /* 写回缓冲中的旧值先写入，之后写入的记录序号更大 */
+    int ret = kv_dirty_flush(handle, true);
+    if (ret != KV_OK) {
+        for (uint32_t i = 0; i < count; i++) {
+            items[i].result = ret;
+        }
+        return ret;
+    }
+    return kv_mset_log(handle, items, count);
+}
+
+/* 事务接口：begin之后的set暂存在事务暂存区 (读取仍返回已提交的值)，commit时整批
+ * 连续写入日志头所在扇区，最后写一条提交标记；启动回放时没有提交标记的批量记录不生效 */
+int flash_kv_tx_begin_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    /* 写回缓冲中的值先写入，事务内的读取和提交都以Flash中的值为准 */
+    int ret = kv_dirty_flush(handle, true);
+    if (ret != KV_OK) {
+        return ret;
+    }
+
+    handle->tx_state = KV_TX_STATE_PREPARED;
+    handle->tx_used = 0;
+    return KV_OK;
+}
+
+/* 暂存的记录中有多少个key不在索引中 (同一key暂存多次时重复计数，偏保守) */
+static uint32_t kv_tx_new_keys(kv_handle_t *handle)
+{
+    uint32_t count = 0;
+    uint32_t offset;
+
+    for (uint32_t pos = 0; pos < handle->tx_used; ) {
+        const kv_record_t *record = (const kv_record_t *)(handle->tx_buf + pos);
+        if (kv_hash_get(&handle->index, record->data,
+                        record->header.key_len, &offset) != 0) {
+            count++;
+        }
+        pos += KV_RECORD_SIZE(record->header.key_len, record->header.value_len);
+    }
+    return count;
+}
+
+int flash_kv_tx_commit_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    if (handle->tx_state != KV_TX_STATE_PREPARED) {
+        return KV_ERR_TRANSACTION;
+    }
+
+    /* 无论成败本批都结束：失败时Flash上没有提交标记，整批不生效 */
+    uint32_t used = handle->tx_used;
+    handle->tx_state = KV_TX_STATE_IDLE;
+    handle->tx_used = 0;
+    if (used == 0) {
+        return KV_OK;
+    }
+    if (kv_hash_reserve(&handle->index, kv_tx_new_keys(handle)) != 0) {
+        return KV_ERR_HASH_FULL;
+    }
+
+    /* 整批连同提交标记放进一个扇区，日志头放不下时打开新扇区 (可能同步回收) */
+    int ret = kv_log_reserve(handle, false, used + KV_COMMIT_SIZE, used);
+    if (ret != KV_OK) {
+        return ret;
+    }
+
+    /* 依次分配序号并计算CRC，提交标记记录本批总长，一次编程写入整批 */
+    for (uint32_t pos = 0; pos < used; ) {
+        kv_record_t *record = (kv_record_t *)(handle->tx_buf + pos);
+        record->header.seq = handle->next_seq++;
+        record->header.crc16 = kv_record_crc(record);
+        pos += KV_RECORD_SIZE(record->header.key_len, record->header.value_len);
+    }
+    kv_record_t *commit = (kv_record_t *)handle->io_buf;
+    memset(commit, 0xFF, sizeof(*commit));
+    commit->header.magic = KV_RECORD_MAGIC;
+    commit->header.flags = (uint8_t)~KV_RECORD_FLAG_COMMIT;
+    commit->header.key_len = 0;
+    commit->header.value_len = sizeof(uint32_t);
+    memcpy(commit->data, &used, sizeof(used));
+    commit->header.seq = handle->next_seq++;
+    commit->header.crc16 = kv_record_crc(commit);
+    memcpy(handle->tx_buf + used, commit, KV_COMMIT_SIZE);
+
+    uint32_t write_offset;
+    if (kv_log_program(handle, false, handle->tx_buf, used + KV_COMMIT_SIZE,
+                       &write_offset) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    /* 提交标记已写入，整批生效：逐条更新哈希表，旧记录转为可回收空间 */
+    for (uint32_t pos = 0; pos < used; ) {
+        const kv_record_t *record = (const kv_record_t *)(handle->tx_buf + pos);
+        uint32_t size = KV_RECORD_SIZE(record->header.key_len, record->header.value_len);
+        uint32_t old_offset;
+        kv_hash_set(&handle->index, record->data, record->header.key_len,
+                    write_offset + pos, &old_offset);
+        kv_space_add(handle, write_offset + pos, size);
+        kv_space_retire(handle, old_offset);
+        pos += size;
+    }
+    handle->dead_bytes += KV_COMMIT_SIZE;
+    handle->record_count = handle->index.count;
+    kv_checkpoint_tick(handle);
+    return KV_OK;
+}
+
+int flash_kv_tx_rollback_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    handle->tx_used = 0;
+    handle->tx_state = KV_TX_STATE_IDLE;
+    return KV_OK;
 }
 
-int flash_kv_status(uint32_t *total, uint32_t *used)
+/* 已关闭扇区的可回收字节：旧版本、删除标记、损坏记录和末尾空隙 */
+static uint32_t kv_sector_dead(const kv_handle_t *handle, uint32_t idx)
+{
+    uint32_t payload = kv_sector_payload(handle);
+    uint32_t live = handle->sectors[idx].live;
+    return (live < payload) ? payload - live : 0;
+}
+
+/* 在序号小于max_seq的已关闭扇区中选择回收扇区，可回收字节不少于min_dead，
+ * 没有时返回-1。按收益/代价评分：可回收字节乘以扇区年龄 (冷数据所在扇区
+ * 的可回收空间短期内不再增长，值得先回收)，除以读出扇区和搬移有效记录的字节数 */
+static int kv_gc_pick(const kv_handle_t *handle, uint32_t max_seq, uint32_t min_dead)
+{
+    uint32_t payload = kv_sector_payload(handle);
+    uint64_t best = 0;
+    int victim = -1;
+
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        uint32_t seq = handle->sectors[i].seq;
+        uint32_t dead = kv_sector_dead(handle, i);
+        if (seq == KV_SECTOR_FREE || kv_sector_is_head(handle, i) || seq >= max_seq ||
+            dead == 0 || dead < min_dead) {
+            continue;
+        }
+
+        uint64_t age = handle->sector_seq - seq;
+        uint64_t score = (uint64_t)dead * age * 1024 / (payload + payload - dead);
+        if (victim < 0 || score > best ||
+            (score == best && seq < handle->sectors[victim].seq)) {
+            best = score;
+            victim = (int)i;
+        }
+    }
+    return victim;
+}
+
+/* 开始回收kv_gc_pick选出的扇区：之后的写入仍追加到日志头 */
+static int kv_gc_start(kv_handle_t *handle, uint32_t max_seq, uint32_t min_dead)
+{
+    int victim = kv_gc_pick(handle, max_seq, min_dead);
+    if (victim < 0) {
+        return -1;
+    }
+
+    handle->gc_state = KV_GC_COPY;
+    handle->gc_victim = (uint32_t)victim;
+    handle->gc_scan_offset = kv_sector_start(handle, (uint32_t)victim) +
+                             sizeof(kv_sector_header_t);
+    return 0;
+}
+
+/* 空闲空间低于阈值且有可回收空间时开始新一轮 */
+static bool kv_gc_wanted(const kv_handle_t *handle)
+{
+    uint32_t capacity = kv_log_capacity(handle);
+    uint32_t free_bytes = kv_log_free(handle);
+
+    return handle->dead_bytes > 0 &&
+           (uint64_t)free_bytes * 100 < (uint64_t)capacity * FLASH_KV_GC_THRESHOLD &&
+           kv_gc_pick(handle, handle->sector_seq, 1) >= 0;
+}
+
+/* 序号为seq的删除标记是否仍需保留：除回收扇区外还有在它写入前打开的扇区，
+ * 其中可能有该key更旧的记录；已回收的扇区有回收标记，重启后不再回放，不计入 */
+static bool kv_gc_tomb_needed(const kv_handle_t *handle, uint32_t seq)
+{
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        const kv_sector_t *sector = &handle->sectors[i];
+        if (i != handle->gc_victim && sector->seq != KV_SECTOR_FREE &&
+            sector->record_seq <= seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 扫描回收扇区的一条记录，有效记录搬移到冷数据流 */
+static int kv_gc_copy_one(kv_handle_t *handle)
+{
+    uint32_t end = kv_sector_start(handle, handle->gc_victim) + handle->block_size;
+    uint32_t offset = handle->gc_scan_offset;
+    kv_record_t *record = (kv_record_t *)handle->io_buf;
+
+    /* 扫描到扇区内日志末尾后进入擦除阶段 */
+    if (offset + sizeof(kv_record_header_t) > end) {
+        handle->gc_state = KV_GC_RETIRE;
+        return KV_OK;
+    }
+    if (kv_record_read(handle, offset, record) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+    if (kv_record_is_erased(&record->header)) {
+        handle->gc_state = KV_GC_RETIRE;
+        return KV_OK;
+    }
+
+    uint32_t size = KV_RECORD_SIZE(record->header.key_len, record->header.value_len);
+    if (!kv_record_header_sane(&record->header) || offset + size > end) {
+        handle->gc_scan_offset += FLASH_KV_WRITE_SIZE;
+        return KV_OK;
+    }
+    handle->gc_scan_offset += size;
+
+    if (kv_record_check_crc(record) != 0) {
+        return KV_OK;
+    }
+
+    /* 删除标记要遮蔽在它之前写入的该key的旧记录：没有其他扇区在它写入前打开，
+     * 或key已重新写入 (索引中是更新的记录) 时可以丢弃，否则搬移到冷数据流，
+     * 仍计为可回收 */
+    uint32_t new_offset;
+    if (kv_record_is_tombstone(&record->header)) {
+        if (!kv_gc_tomb_needed(handle, record->header.seq) ||
+            kv_hash_get(&handle->index, record->data, record->header.key_len,
+                        &new_offset) == 0) {
+            return KV_OK;
+        }
+        if (kv_log_write(handle, true, record, &new_offset) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+        handle->dead_bytes += size;
+        handle->gc_moved += size;
+        return KV_OK;
+    }
+
+    /* 索引仍指向该记录时才是最新记录：经过一轮回收仍然有效，视为冷数据，原样追加到
+     * 冷数据流 (保留序号) 并原地更新槽内偏移，不再与频繁更新的记录混在同一扇区 */
+    if (!kv_hash_points_to(&handle->index, record->data, record->header.key_len, offset)) {
+        return KV_OK;
+    }
+    /* 已提交的批量记录搬移后单独生效，清除批量标记 (序号不变) */
+    if (kv_record_is_batch(&record->header)) {
+        record->header.flags |= KV_RECORD_FLAG_BATCH;
+        record->header.crc16 = kv_record_crc(record);
+    }
+    if (kv_log_write(handle, true, record, &new_offset) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+    kv_hash_relocate(&handle->index, record->data, record->header.key_len, offset, new_offset);
+    kv_cache_move(handle, offset, new_offset);
+
+    /* 有效字节随记录转到新扇区，原记录随扇区擦除，先计为可回收 */
+    kv_sector_t *victim = &handle->sectors[handle->gc_victim];
+    victim->live = (victim->live > size) ? victim->live - size : 0;
+    kv_sector_of(handle, new_offset)->live += size;
+    handle->dead_bytes += size;
+    handle->gc_moved += size;
+    return KV_OK;
+}
+
+/* 回收扇区放回空闲扇区，不在此擦除：擦除留给flash_kv_pre_erase()或打开该扇区时，
+ * 写入路径上的同步回收不等待擦除。先在头部写回收标记，未擦除前重启时该扇区视为空闲，
+ * 不再回放也不占用GC的空闲扇区；标记写入失败时立即擦除 */
+static int kv_gc_retire(kv_handle_t *handle)
+{
+    uint32_t start = kv_sector_start(handle, handle->gc_victim);
+    kv_sector_t *sector = &handle->sectors[handle->gc_victim];
+    uint8_t mark[FLASH_KV_WRITE_SIZE];
+
+    memset(mark, 0, sizeof(mark));
+    if (handle->ops->write(handle->base_addr + start + offsetof(kv_sector_header_t, retired),
+                           mark, sizeof(mark)) != 0 &&
+        kv_sector_erase(handle, handle->gc_victim) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    /* 搬移时有效字节随记录转出，仍有剩余说明有槽指向该扇区中无法搬移的记录
+     * (在Flash上已损坏)，之后回放日志丢弃这些槽；不必扫描整个索引 */
+    bool stranded = (sector->live != 0);
+    sector->seq = KV_SECTOR_FREE;
+    sector->live = 0;
+    handle->free_sectors++;
+    kv_cache_drop_range(handle, start, start + handle->block_size);
+    handle->gc_state = KV_GC_IDLE;
+    handle->gc_reclaimed++;
+
+    uint32_t payload = kv_sector_payload(handle);
+    handle->dead_bytes = (handle->dead_bytes > payload) ? handle->dead_bytes - payload : 0;
+
+    if (stranded) {
+        kv_index_recover(handle);
+    }
+    handle->record_count = handle->index.count;
+    return KV_OK;
+}
+
+/* 增量GC - 每次最多执行budget步 (扫描一条记录或放回回收扇区) */
+int flash_kv_gc_step_h(kv_handle_t *handle, uint32_t budget)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    if (handle->gc_state == KV_GC_IDLE &&
+        (!kv_gc_wanted(handle) || kv_gc_start(handle, handle->sector_seq, 1) != 0)) {
+        return KV_OK;
+    }
+    if (budget == 0) {
+        budget = 1;
+    }
+
+    /* 失败时放弃本轮：已搬移的记录槽已指向新位置，未搬移的仍指向回收扇区，
+     * 日志保持有效，重复的记录序号相同，回放时后者生效 */
+    for (; budget > 0; budget--) {
+        int ret = (handle->gc_state == KV_GC_COPY) ? kv_gc_copy_one(handle)
+                                                   : kv_gc_retire(handle);
+        if (ret != KV_OK) {
+            handle->gc_state = KV_GC_IDLE;
+            return ret;
+        }
+        if (handle->gc_state == KV_GC_IDLE) {
+            return KV_OK;
+        }
+    }
+    return KV_GC_PENDING;
+}
+
+/* GC接口 - 逐个回收含可回收记录的扇区 (按收益从高到低)，只有末尾空隙的扇区
+ * 不搬移，搬移的字节数只与垃圾所在扇区的有效记录有关 */
+int flash_kv_gc_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    /* 追加扇区中有可回收记录且有空闲扇区可用时换到新扇区，原扇区同样被回收 */
+    for (int cold = 0; cold < 2; cold++) {
+        if (handle->free_sectors > 1 && kv_head_dead(handle, cold != 0) > 0 &&
+            kv_log_advance(handle, cold != 0) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+    }
+
+    /* 回收期间打开的扇区序号更大，不在本次回收范围内；末尾空隙小于一条最大记录 */
+    uint32_t max_seq = handle->sector_seq + 1;
+    for (;;) {
+        if (handle->gc_state == KV_GC_IDLE &&
+            kv_gc_start(handle, max_seq, KV_RECORD_MAX_SIZE) != 0) {
+            break;
+        }
+        int ret = kv_gc_reclaim(handle);
+        if (ret != KV_OK) {
+            return ret;
+        }
+        /* 同步GC不在写入路径上，回收后立即擦除 */
+        if (flash_kv_pre_erase_h(handle, UINT32_MAX) < 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+    }
+
+    kv_checkpoint_save(handle, &handle->index);
+    return KV_OK;
+}
+
+/* 预擦除 - 按打开顺序擦除最多count个尚未擦除的空闲扇区，返回仍待擦除的扇区数；
+ * 还有余量时保存到期的索引快照 (待保存的快照也计入返回值) */
+int flash_kv_pre_erase_h(kv_handle_t *handle, uint32_t count)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    int pending = 0;
+    for (uint32_t i = 1; i <= handle->sector_count; i++) {
+        uint32_t idx = (handle->head_sector + i) % handle->sector_count;
+        const kv_sector_t *sector = &handle->sectors[idx];
+        if (sector->seq != KV_SECTOR_FREE || sector->erased) {
+            continue;
+        }
+        if (count == 0) {
+            pending++;
+            continue;
+        }
+        if (kv_sector_erase(handle, idx) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+        count--;
+    }
+
+    /* 快照到期时在这里擦除较旧半区并保存，写入路径只计数；保存失败不影响数据，
+     * 计数保留，下次空闲时重试 */
+    if (kv_checkpoint_due(handle)) {
+        if (count == 0) {
+            pending++;
+        } else {
+            kv_checkpoint_save(handle, &handle->index);
+        }
+    }
+    return pending;
+}
+
+/* 立即保存索引快照 */
+int flash_kv_checkpoint_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    if (handle->ckpt_size == 0) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    return kv_checkpoint_save(handle, &handle->index);
+}
+
+uint8_t flash_kv_free_percent_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return 0;
+    }
+    uint32_t used = handle->live_bytes;
+    uint32_t total = kv_log_capacity(handle);
+    if (used >= total) return 0;
+    return (uint8_t)((total - used) * 100 / total);
+}
+
+/* 批量操作接口 - 简化实现 */
+int flash_kv_foreach_h(kv_handle_t *handle, kv_foreach_cb callback, void *user_data)
+{
+    (void)handle;
+    (void)callback;
+    (void)user_data;
+    return KV_ERR_NOT_FOUND;
+}
+
+int flash_kv_clear_h(kv_handle_t *handle)
+{
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+
+    /* 擦除所有扇区 (已知或检查为擦除态的跳过)，以更大的扇区序号重新打开日志头，
+     * 旧快照随之失效；进行中的GC作废，冷数据流在下次GC搬移或删除时重新打开 */
+    handle->gc_state = KV_GC_IDLE;
+    handle->cold_sector = KV_SECTOR_NONE;
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        kv_sector_t *sector = &handle->sectors[i];
+        if ((sector->seq != KV_SECTOR_FREE || !sector->erased) &&
+            kv_sector_erase(handle, i) != 0) {
+            return KV_ERR_FLASH_FAIL;
+        }
+        sector->seq = KV_SECTOR_FREE;
+    }
+    kv_space_reset(handle);
+    handle->free_sectors = handle->sector_count;
+    if (kv_sector_open(handle, 0, false) != 0) {
+        return KV_ERR_FLASH_FAIL;
+    }
+
+    /* 清除内存中的哈希表、值缓存和计数 */
+    kv_hash_clear(&handle->index);
+    kv_cache_clear(handle);
+    for (uint32_t i = 0; i < handle->dirty_entries; i++) {
+        handle->dirty[i].key_len = 0;
+    }
+    handle->dirty_count = 0;
+    handle->record_count = 0;
+
+    return KV_OK;
+}
+
+int flash_kv_cache_stats_h(kv_handle_t *handle, uint32_t *hits, uint32_t *misses)
+{
+    if (hits == NULL || misses == NULL) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    *hits = handle->cache_hits;
+    *misses = handle->cache_misses;
+    return KV_OK;
+}
+
+int flash_kv_index_stats_h(kv_handle_t *handle, uint32_t *entries, uint32_t *max_probe,
+                           uint32_t *total_probe)
 {
-    kv_handle_t *handle = &g_handles[0];
-    *total = handle->region_size - handle->block_size - sizeof(kv_region_header_t);
-    *used = handle->record_count * sizeof(kv_record_t);
+    if (entries == NULL || max_probe == NULL || total_probe == NULL) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    *entries = handle->index.count;
+    kv_hash_probe_stats(&handle->index, max_probe, total_probe);
+    return KV_OK;
+}
+
+uint32_t flash_kv_count_h(kv_handle_t *handle)
+{
+    return kv_handle_ready(handle) ? handle->record_count + kv_dirty_new_keys(handle) : 0;
+}
+
+int flash_kv_status_h(kv_handle_t *handle, uint32_t *total, uint32_t *used)
+{
+    if (total == NULL || used == NULL) {
+        return KV_ERR_INVALID_PARAM;
+    }
+    if (!kv_handle_ready(handle)) {
+        return KV_ERR_NO_INIT;
+    }
+    *total = kv_log_capacity(handle);
+    *used = handle->live_bytes;
     return KV_OK;
 }
+
+/*============================================================================
+ * 实例0的全局接口
+ *============================================================================*/
+
+int flash_kv_set(const uint8_t *key, uint8_t key_len,
+                 const uint8_t *value, uint8_t value_len)
+{
+    return flash_kv_set_h(&g_handles[0], key, key_len, value, value_len);
+}
+
+int flash_kv_get(const uint8_t *key, uint8_t key_len,
+                 uint8_t *value, uint8_t *value_len)
+{
+    return flash_kv_get_h(&g_handles[0], key, key_len, value, value_len);
+}
+
+int flash_kv_del(const uint8_t *key, uint8_t key_len)
+{
+    return flash_kv_del_h(&g_handles[0], key, key_len);
+}
+
+int flash_kv_set_hashed(const uint8_t *key, uint8_t key_len, uint32_t hash,
+                        const uint8_t *value, uint8_t value_len)
+{
+    return flash_kv_set_hashed_h(&g_handles[0], key, key_len, hash, value, value_len);
+}
+
+int flash_kv_get_hashed(const uint8_t *key, uint8_t key_len, uint32_t hash,
+                        uint8_t *value, uint8_t *value_len)
+{
+    return flash_kv_get_hashed_h(&g_handles[0], key, key_len, hash, value, value_len);
+}
+
+int flash_kv_del_hashed(const uint8_t *key, uint8_t key_len, uint32_t hash)
+{
+    return flash_kv_del_hashed_h(&g_handles[0], key, key_len, hash);
+}
+
+bool flash_kv_exists(const uint8_t *key, uint8_t key_len)
+{
+    return flash_kv_exists_h(&g_handles[0], key, key_len);
+}
+
+int flash_kv_get_ref(const uint8_t *key, uint8_t key_len, kv_ref_t *ref)
+{
+    return flash_kv_get_ref_h(&g_handles[0], key, key_len, ref);
+}
+
+bool flash_kv_ref_valid(const kv_ref_t *ref)
+{
+    return flash_kv_ref_valid_h(&g_handles[0], ref);
+}
+
+int flash_kv_mget(kv_item_t *items, uint32_t count)
+{
+    return flash_kv_mget_h(&g_handles[0], items, count);
+}
+
+int flash_kv_mset(kv_item_t *items, uint32_t count)
+{
+    return flash_kv_mset_h(&g_handles[0], items, count);
+}
+
+int flash_kv_poll(uint32_t now)
+{
+    return flash_kv_poll_h(&g_handles[0], now);
+}
+
+int flash_kv_flush(void)
+{
+    return flash_kv_flush_h(&g_handles[0]);
+}
+
+int flash_kv_tx_begin(void)
+{
+    return flash_kv_tx_begin_h(&g_handles[0]);
+}
+
+int flash_kv_tx_commit(void)
+{
+    return flash_kv_tx_commit_h(&g_handles[0]);
+}
+
+int flash_kv_tx_rollback(void)
+{
+    return flash_kv_tx_rollback_h(&g_handles[0]);
+}
+
+int flash_kv_gc(void)
+{
+    return flash_kv_gc_h(&g_handles[0]);
+}
+
+int flash_kv_gc_step(uint32_t budget)
+{
+    return flash_kv_gc_step_h(&g_handles[0], budget);
+}
+
+int flash_kv_pre_erase(uint32_t count)
+{
+    return flash_kv_pre_erase_h(&g_handles[0], count);
+}
+
+int flash_kv_checkpoint(void)
+{
+    return flash_kv_checkpoint_h(&g_handles[0]);
+}
+
+uint8_t flash_kv_free_percent(void)
+{
+    return flash_kv_free_percent_h(&g_handles[0]);
+}
+
+int flash_kv_foreach(kv_foreach_cb callback, void *user_data)
+{
+    return flash_kv_foreach_h(&g_handles[0], callback, user_data);
+}
+
+int flash_kv_clear(void)
+{
+    return flash_kv_clear_h(&g_handles[0]);
+}
+
+uint32_t flash_kv_count(void)
+{
+    return flash_kv_count_h(&g_handles[0]);
+}
+
+int flash_kv_status(uint32_t *total, uint32_t *used)
+{
+    return flash_kv_status_h(&g_handles[0], total, used);
+}
+
+int flash_kv_cache_stats(uint32_t *hits, uint32_t *misses)
+{
+    return flash_kv_cache_stats_h(&g_handles[0], hits, misses);
+}
+
+int flash_kv_index_stats(uint32_t *entries, uint32_t *max_probe, uint32_t *total_probe)
+{
+    return flash_kv_index_stats_h(&g_handles[0], entries, max_probe, total_probe);
+}
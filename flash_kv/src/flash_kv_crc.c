@@ -1,7 +1,9 @@
 /**
  * @file flash_kv_crc.c
  * @brief CRC 校验实现
- * @description 提供CRC-16和CRC-32校验算法，用于数据完整性验证
+ * @description 提供CRC-16和CRC-32校验算法，用于数据完整性验证。
+ *             计算方式由 FLASH_KV_CRC_METHOD 选择：逐位、256项查表或slicing-by-8；
+ *             FLASH_KV_CRC32_CASTAGNOLI 时CRC-32改用CRC32C，x86 SSE4.2下使用硬件指令
  * @author EasyData
  * @date 2026-02-25
  * @version 1.0.0
@@ -9,10 +11,23 @@
 
 #include "flash_kv_crc.h"
 
-/* CRC-16-CCITT 计算 */
-uint16_t kv_crc16(const uint8_t *data, uint32_t len)
+#if FLASH_KV_CRC_METHOD != KV_CRC_METHOD_BITWISE
+#include "flash_kv_crc_table.h"
+#endif
+
+#if FLASH_KV_CRC32_CASTAGNOLI && defined(__SSE4_2__)
+#include <string.h>
+#include <nmmintrin.h>
+#endif
+
+/*============================================================================
+ * CRC-16-CCITT (多项式0x1021，高位优先)
+ *============================================================================*/
+
+#if FLASH_KV_CRC_METHOD == KV_CRC_METHOD_BITWISE
+
+uint16_t kv_crc16_update(uint16_t crc, const uint8_t *data, uint32_t len)
 {
-    uint16_t crc = 0xFFFF;
     for (uint32_t i = 0; i < len; i++) {
         crc ^= (uint16_t)data[i] << 8;
         for (int j = 0; j < 8; j++) {
@@ -26,10 +41,66 @@ uint16_t kv_crc16(const uint8_t *data, uint32_t len)
     return crc;
 }
 
-/* CRC-32 计算 */
-uint32_t kv_crc32(const uint8_t *data, uint32_t len)
+#else
+
+uint16_t kv_crc16_update(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+#if FLASH_KV_CRC_METHOD == KV_CRC_METHOD_SLICE8
+    /* 每次处理8字节：前2字节与当前CRC合并，8个字节各查一张表后异或 */
+    while (len >= 8) {
+        uint16_t c = crc ^ (uint16_t)((data[0] << 8) | data[1]);
+        crc = kv_crc16_table[7][c >> 8] ^ kv_crc16_table[6][c & 0xFF] ^
+              kv_crc16_table[5][data[2]] ^ kv_crc16_table[4][data[3]] ^
+              kv_crc16_table[3][data[4]] ^ kv_crc16_table[2][data[5]] ^
+              kv_crc16_table[1][data[6]] ^ kv_crc16_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+#endif
+    while (len--) {
+        crc = (uint16_t)(crc << 8) ^ kv_crc16_table[0][(crc >> 8) ^ *data++];
+    }
+    return crc;
+}
+
+#endif
+
+/*============================================================================
+ * CRC-32
+ *============================================================================*/
+
+#if FLASH_KV_CRC32_CASTAGNOLI
+
+/* CRC32C (多项式0x82F63B78，低位优先) */
+uint32_t kv_crc32_update(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+#if defined(__SSE4_2__)
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = (uint32_t)_mm_crc32_u64(crc, word);
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+#else
+    while (len--) {
+        crc ^= *data++;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        }
+    }
+#endif
+    return crc;
+}
+
+#elif FLASH_KV_CRC_METHOD == KV_CRC_METHOD_BITWISE
+
+/* CRC-32 (多项式0x04C11DB7，高位优先) */
+uint32_t kv_crc32_update(uint32_t crc, const uint8_t *data, uint32_t len)
 {
-    uint32_t crc = 0xFFFFFFFF;
     for (uint32_t i = 0; i < len; i++) {
         crc ^= (uint32_t)data[i] << 24;
         for (int j = 0; j < 8; j++) {
@@ -40,5 +111,47 @@ uint32_t kv_crc32(const uint8_t *data, uint32_t len)
             }
         }
     }
+    return crc;
+}
+
+#else
+
+/* CRC-32 (多项式0x04C11DB7，高位优先) */
+uint32_t kv_crc32_update(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+#if FLASH_KV_CRC_METHOD == KV_CRC_METHOD_SLICE8
+    while (len >= 8) {
+        uint32_t c = crc ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                            ((uint32_t)data[2] << 8) | data[3]);
+        crc = kv_crc32_table[7][c >> 24] ^ kv_crc32_table[6][(c >> 16) & 0xFF] ^
+              kv_crc32_table[5][(c >> 8) & 0xFF] ^ kv_crc32_table[4][c & 0xFF] ^
+              kv_crc32_table[3][data[4]] ^ kv_crc32_table[2][data[5]] ^
+              kv_crc32_table[1][data[6]] ^ kv_crc32_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+#endif
+    while (len--) {
+        crc = (crc << 8) ^ kv_crc32_table[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+#endif
+
+uint32_t kv_crc32_final(uint32_t crc)
+{
     return crc ^ 0xFFFFFFFF;
 }
+
+/* CRC-16-CCITT 计算 */
+uint16_t kv_crc16(const uint8_t *data, uint32_t len)
+{
+    return kv_crc16_update(KV_CRC16_INIT, data, len);
+}
+
+/* CRC-32 计算 */
+uint32_t kv_crc32(const uint8_t *data, uint32_t len)
+{
+    return kv_crc32_final(kv_crc32_update(KV_CRC32_INIT, data, len));
+}
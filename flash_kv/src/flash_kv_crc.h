@@ -1,7 +1,7 @@
 /**
  * @file flash_kv_crc.h
  * @brief CRC 校验头文件
- * @description CRC16/CRC32 校验函数声明
+ * @description CRC16/CRC32 校验函数声明，支持一次性计算与分段计算
  * @author EasyData
  * @date 2026-02-25
  * @version 1.0.0
@@ -11,8 +11,17 @@
 #define FLASH_KV_CRC_H
 
 #include <stdint.h>
+#include "flash_kv_config.h"
+
+/* 分段计算初值：crc = INIT; crc = update(crc, ...); ...; 结果 = final(crc) */
+#define KV_CRC16_INIT   0xFFFF
+#define KV_CRC32_INIT   0xFFFFFFFF
 
 uint16_t kv_crc16(const uint8_t *data, uint32_t len);
 uint32_t kv_crc32(const uint8_t *data, uint32_t len);
 
+uint16_t kv_crc16_update(uint16_t crc, const uint8_t *data, uint32_t len);
+uint32_t kv_crc32_update(uint32_t crc, const uint8_t *data, uint32_t len);
+uint32_t kv_crc32_final(uint32_t crc);
+
 #endif
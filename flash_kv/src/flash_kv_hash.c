@@ -1,7 +1,11 @@
 /**
  * @file flash_kv_hash.c
  * @brief 哈希表实现
- * @description 使用DJB2哈希函数和开放地址法实现O(1)查找的哈希表
+ * @description 使用每次处理8字节的乘法混合哈希 (或DJB2) 和开放地址法实现O(1)查找的哈希表，
+ *             支持完整key槽和仅保存哈希指纹的紧凑槽两种模式。
+ *             每槽另有1字节控制标签，查找时一次匹配16个标签 (SSE2或SWAR)，
+ *             插入采用Robin Hood置换，删除采用后移，最长探测距离有界。
+ *             提供分配器时接近满载自动扩容，旧表在之后的set/del中逐步搬移
  * @author EasyData
  * @date 2026-02-25
  * @version 1.0.0
@@ -9,88 +13,652 @@
 
 #include <string.h>
 #include "flash_kv_hash.h"
+#if FLASH_KV_INDEX_SSE2
+#include <emmintrin.h>
+#endif
+
+/* 控制字节：空槽为0x80，占用槽为key哈希的高7位 (0x00~0x7F) */
+#define KV_CTRL_EMPTY   0x80
+
+/* 索引的负载上限 (87.5%)：可扩容的表超过时扩容，固定大小的表超过时拒绝新key，
+ * 避免表接近满时探测链变得很长 */
+#define KV_HASH_LOAD_LIMIT(size)  ((size) - (size) / 8)
+
+/* 扩容期间每次set/del从旧表搬移的槽数：旧表在新表达到负载上限前早已搬完 */
+#define KV_HASH_MIGRATE_STEP      16
+
+#if FLASH_KV_HASH_METHOD == KV_HASH_METHOD_DJB2
 
 /* DJB2 哈希函数 */
-static uint16_t kv_hash_djb2(const uint8_t *key, uint8_t len)
+uint32_t kv_hash_key(const uint8_t *key, uint8_t len)
 {
     uint32_t hash = 5381;
     for (uint8_t i = 0; i < len; i++) {
         hash = ((hash << 5) + hash) + key[i];
     }
-    return hash & (FLASH_KV_HASH_SIZE - 1);
+    return hash;
+}
+
+#else
+
+#define KV_HASH_P0  0x53c5ca59u
+#define KV_HASH_P1  0x74743c1bu
+
+/* 按小端读取4字节 (与平台字节序和对齐无关，主机和目标算出的哈希相同) */
+static uint32_t kv_hash_read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* 32x32->64位乘法后高低两半异或 (Cortex-M3/M4上为一条UMULL) */
+static uint32_t kv_hash_mum(uint32_t a, uint32_t b)
+{
+    uint64_t r = (uint64_t)a * b;
+    return (uint32_t)r ^ (uint32_t)(r >> 32);
+}
+
+/* wyhash类哈希：每轮用一次乘法混合8字节，不足8字节的尾部重叠读取，最后做一次雪崩。
+ * 常数P0含最高位为1的字节，ASCII key与之异或不会为0 */
+uint32_t kv_hash_key(const uint8_t *key, uint8_t len)
+{
+    uint32_t seed = KV_HASH_P1 ^ len;
+    uint32_t n = len;
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    while (n > 8) {
+        seed = kv_hash_mum(kv_hash_read32(key) ^ KV_HASH_P0, kv_hash_read32(key + 4) ^ seed);
+        key += 8;
+        n -= 8;
+    }
+    if (n >= 4) {
+        a = kv_hash_read32(key);
+        b = kv_hash_read32(key + n - 4);
+    } else if (n > 0) {
+        a = ((uint32_t)key[0] << 16) | ((uint32_t)key[n >> 1] << 8) | key[n - 1];
+    }
+    seed = kv_hash_mum(a ^ KV_HASH_P0, b ^ seed);
+
+    seed ^= seed >> 16;
+    seed *= 0x85ebca6bu;
+    seed ^= seed >> 13;
+    seed *= 0xc2b2ae35u;
+    seed ^= seed >> 16;
+    return seed;
+}
+
+#endif
+
+/* 低位决定探测起点，高7位作为控制标签，两者独立 */
+static uint8_t kv_hash_tag(uint32_t hash)
+{
+    return (uint8_t)(hash >> 25);
+}
+
+#if FLASH_KV_INDEX_SSE2
+
+/* 一组16个控制字节中等于ctrl的位置，第i位对应第i个槽 */
+static uint32_t kv_group_match(const uint8_t *group, uint8_t ctrl)
+{
+    __m128i g = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)ctrl)));
+}
+
+#else
+
+/* 一组16个控制字节中等于ctrl的位置 (SWAR：每次比较4字节，只用32位整数运算) */
+static uint32_t kv_group_match(const uint8_t *group, uint8_t ctrl)
+{
+    uint32_t pattern = ctrl * 0x01010101u;
+    uint32_t mask = 0;
+
+    for (uint32_t w = 0; w < KV_HASH_GROUP / 4; w++) {
+        const uint8_t *p = group + w * 4;
+        uint32_t x = ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                      ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24)) ^ pattern;
+        /* 等于ctrl的字节异或后为0，置其最高位；逐字节加法不跨字节进位，不会误判 */
+        uint32_t zero = ~(((x & 0x7F7F7F7Fu) + 0x7F7F7F7Fu) | x | 0x7F7F7F7Fu);
+        /* 4个最高位收拢到第21~24位 */
+        mask |= ((((zero >> 7) * 0x00204081u) >> 21) & 0xFu) << (w * 4);
+    }
+    return mask;
+}
+
+#endif
+
+#if FLASH_KV_INDEX_FINGERPRINT
+
+/* 指纹相同后还需读取Flash比对完整key，排除哈希碰撞 */
+static bool kv_slot_match(const kv_hash_table_t *table, const kv_hash_slot_t *slot,
+                          uint32_t hash, const uint8_t *key, uint8_t key_len)
+{
+    return slot->fingerprint == hash &&
+           table->match(table->match_ctx, slot->flash_offset, key, key_len);
+}
+
+static void kv_slot_fill(kv_hash_slot_t *slot, uint32_t hash,
+                         const uint8_t *key, uint8_t key_len)
+{
+    (void)key;
+    (void)key_len;
+    slot->fingerprint = hash;
 }
 
-/* 哈希表初始化 */
-void kv_hash_init(kv_hash_table_t *table)
+static bool kv_slot_is(const kv_hash_slot_t *slot, uint32_t hash,
+                       const uint8_t *key, uint8_t key_len)
+{
+    (void)key;
+    (void)key_len;
+    return slot->fingerprint == hash;
+}
+
+#else
+
+static bool kv_slot_match(const kv_hash_table_t *table, const kv_hash_slot_t *slot,
+                          uint32_t hash, const uint8_t *key, uint8_t key_len)
+{
+    (void)table;
+    return slot->hash == hash && slot->key_len == key_len &&
+           memcmp(slot->key, key, key_len) == 0;
+}
+
+static void kv_slot_fill(kv_hash_slot_t *slot, uint32_t hash,
+                         const uint8_t *key, uint8_t key_len)
+{
+    slot->hash = hash;
+    slot->key_len = key_len;
+    memcpy(slot->key, key, key_len);
+}
+
+/* 只比较槽内保存的指纹/key，不读取Flash */
+static bool kv_slot_is(const kv_hash_slot_t *slot, uint32_t hash,
+                       const uint8_t *key, uint8_t key_len)
+{
+    return slot->hash == hash && slot->key_len == key_len &&
+           memcmp(slot->key, key, key_len) == 0;
+}
+
+#endif
+
+/* 槽中条目的哈希 (探测起点) */
+static uint32_t kv_slot_hash(const kv_hash_slot_t *slot)
+{
+#if FLASH_KV_INDEX_FINGERPRINT
+    return slot->fingerprint;
+#else
+    return slot->hash;
+#endif
+}
+
+static bool kv_slot_used(const kv_hash_table_t *table, uint32_t idx)
+{
+    return table->ctrl[idx] != KV_CTRL_EMPTY;
+}
+
+/* 写控制字节；前GROUP-1个控制字节在数组末尾有副本，从任意槽开始都能连续读取一组 */
+static void kv_ctrl_set(kv_hash_table_t *table, uint32_t idx, uint8_t ctrl)
+{
+    table->ctrl[idx] = ctrl;
+    for (uint32_t i = idx + table->size; i < table->size + KV_HASH_GROUP - 1; i += table->size) {
+        table->ctrl[i] = ctrl;
+    }
+}
+
+/* 使用slots开始的槽数组和控制字节 (见KV_INDEX_BUF_SIZE)，全部置空 */
+static void kv_hash_attach(kv_hash_table_t *table, kv_hash_slot_t *slots, uint32_t size)
+{
+    table->slots = slots;
+    table->ctrl = (uint8_t *)(slots + size);
+    table->size = size;
+    table->max_dist = 0;
+    memset(table->slots, 0, size * sizeof(kv_hash_slot_t));
+    memset(table->ctrl, KV_CTRL_EMPTY, size + KV_HASH_GROUP - 1);
+}
+
+/* 释放扩容中的旧表 */
+static void kv_hash_drop_old(kv_hash_table_t *table)
+{
+    if (table->old != NULL) {
+        table->allocator->free(table->allocator->ctx, table->old->slots);
+        table->allocator->free(table->allocator->ctx, table->old);
+        table->old = NULL;
+    }
+}
+
+/* 哈希表初始化，槽数组由调用者提供，控制字节紧随其后 (见KV_INDEX_BUF_SIZE) */
+void kv_hash_init(kv_hash_table_t *table, kv_hash_slot_t *slots, uint32_t size,
+                  kv_hash_match_fn match, void *ctx)
 {
     memset(table, 0, sizeof(kv_hash_table_t));
+#if FLASH_KV_INDEX_FINGERPRINT
+    table->match = match;
+    table->match_ctx = ctx;
+#else
+    (void)match;
+    (void)ctx;
+#endif
+    kv_hash_attach(table, slots, size);
 }
 
-/* 哈希表查找 */
-int kv_hash_get(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
-                uint32_t *offset)
+/* 从分配器分配size个槽初始化，之后可以扩容 */
+int kv_hash_init_alloc(kv_hash_table_t *table, const kv_allocator_t *allocator, uint32_t size,
+                       kv_hash_match_fn match, void *ctx)
 {
-    uint16_t hash = kv_hash_djb2(key, key_len);
+    kv_hash_slot_t *slots = allocator->alloc(allocator->ctx, KV_INDEX_BUF_SIZE(size));
 
-    for (int i = 0; i < FLASH_KV_HASH_SIZE; i++) {
-        uint16_t idx = (hash + i) & (FLASH_KV_HASH_SIZE - 1);
-        kv_hash_slot_t *slot = &table->slots[idx];
+    if (slots == NULL) {
+        return -1;
+    }
+    kv_hash_init(table, slots, size, match, ctx);
+    table->allocator = allocator;
+    return 0;
+}
 
-        if (slot->key_len == 0) {
+/* 释放分配器分配的槽数组，固定大小的表不做处理 */
+void kv_hash_release(kv_hash_table_t *table)
+{
+    if (table->allocator != NULL) {
+        kv_hash_drop_old(table);
+        table->allocator->free(table->allocator->ctx, table->slots);
+        memset(table, 0, sizeof(kv_hash_table_t));
+    }
+}
+
+/* 清空所有槽，扩容中的旧表直接释放 */
+void kv_hash_clear(kv_hash_table_t *table)
+{
+    kv_hash_drop_old(table);
+    kv_hash_attach(table, table->slots, table->size);
+    table->count = 0;
+}
+
+/* 查找key所在的槽，不存在返回-1。
+ * 从起点开始每次匹配一组控制字节，只有标签相同的槽才比较key；
+ * 组内有空槽说明key不在更后面。Robin Hood下条目离起点不超过max_dist，查找长度有界 */
+static int32_t kv_hash_find(const kv_hash_table_t *table, uint32_t hash,
+                            const uint8_t *key, uint8_t key_len)
+{
+    uint32_t mask = table->size - 1;
+    uint32_t home = hash & mask;
+    uint8_t tag = kv_hash_tag(hash);
+
+    for (uint32_t dist = 0; dist <= table->max_dist; dist += KV_HASH_GROUP) {
+        const uint8_t *group = &table->ctrl[(home + dist) & mask];
+        uint32_t hits = kv_group_match(group, tag);
+
+        while (hits != 0) {
+            uint32_t d = dist + (uint32_t)__builtin_ctz(hits);
+            if (d > table->max_dist) {
+                break;
+            }
+            uint32_t idx = (home + d) & mask;
+            if (kv_slot_match(table, &table->slots[idx], hash, key, key_len)) {
+                return (int32_t)idx;
+            }
+            hits &= hits - 1;
+        }
+        if (kv_group_match(group, KV_CTRL_EMPTY) != 0) {
             return -1;
         }
+    }
+    return -1;
+}
+
+/* 按偏移查找key的槽 (不读取Flash)：只检查标签相同的槽，每条记录的偏移唯一 */
+static int32_t kv_hash_find_offset(const kv_hash_table_t *table, uint32_t hash,
+                                   uint32_t offset)
+{
+    uint32_t mask = table->size - 1;
+    uint8_t tag = kv_hash_tag(hash);
 
-        if (slot->key_len == key_len && memcmp(slot->key, key, key_len) == 0) {
-            *offset = slot->flash_offset;
-            return 0;
+    for (uint32_t d = 0; d <= table->max_dist; d++) {
+        uint32_t idx = (hash + d) & mask;
+        if (!kv_slot_used(table, idx)) {
+            return -1;
+        }
+        if (table->ctrl[idx] == tag && table->slots[idx].flash_offset == offset) {
+            return (int32_t)idx;
         }
     }
     return -1;
 }
 
+/* Robin Hood插入 (调用者保证key不在表中且有空槽，计数由调用者维护)：
+ * 遇到离起点比自己近的条目时占据其位置，被挤出的条目继续向后探测。
+ * 各条目离起点的距离趋于平均，最长探测距离随负载缓慢增长 */
+static void kv_hash_insert(kv_hash_table_t *table, kv_hash_slot_t entry, uint32_t hash)
+{
+    uint32_t mask = table->size - 1;
+    uint32_t idx = hash & mask;
+    uint32_t dist = 0;
+    uint8_t tag = kv_hash_tag(hash);
+
+    for (;;) {
+        if (!kv_slot_used(table, idx)) {
+            table->slots[idx] = entry;
+            kv_ctrl_set(table, idx, tag);
+            if (dist > table->max_dist) {
+                table->max_dist = dist;
+            }
+            return;
+        }
+
+        uint32_t resident = (idx - kv_slot_hash(&table->slots[idx])) & mask;
+        if (resident < dist) {
+            kv_hash_slot_t displaced = table->slots[idx];
+            uint8_t displaced_tag = table->ctrl[idx];
+
+            table->slots[idx] = entry;
+            kv_ctrl_set(table, idx, tag);
+            if (dist > table->max_dist) {
+                table->max_dist = dist;
+            }
+            entry = displaced;
+            tag = displaced_tag;
+            dist = resident;
+        }
+        idx = (idx + 1) & mask;
+        dist++;
+    }
+}
+
+/* 后移删除 (计数由调用者维护)：其后不在探测起点的条目逐个前移一格，
+ * 直到空槽或已在起点的条目。不留删除标记，探测链保持连续，表的状态与从未插入被删key相同。
+ * max_dist只在清空时复位，删除后仍是有效上界 */
+static void kv_hash_remove_at(kv_hash_table_t *table, uint32_t idx)
+{
+    uint32_t mask = table->size - 1;
+    uint32_t next = (idx + 1) & mask;
+
+    while (kv_slot_used(table, next) &&
+           ((next - kv_slot_hash(&table->slots[next])) & mask) != 0) {
+        table->slots[idx] = table->slots[next];
+        kv_ctrl_set(table, idx, table->ctrl[next]);
+        idx = next;
+        next = (next + 1) & mask;
+    }
+    memset(&table->slots[idx], 0, sizeof(kv_hash_slot_t));
+    kv_ctrl_set(table, idx, KV_CTRL_EMPTY);
+}
+
+/* 从旧表搬移最多budget个槽到本表，旧表搬空后释放。
+ * 旧表用后移删除取出条目，其余条目仍可查找；后移会把后面的条目移到当前位置，
+ * 所以当前位置空了才前进 */
+static void kv_hash_migrate(kv_hash_table_t *table, uint32_t budget)
+{
+    kv_hash_table_t *old = table->old;
+
+    if (old == NULL) {
+        return;
+    }
+    while (budget-- > 0 && table->migrate_pos < old->size) {
+        uint32_t pos = table->migrate_pos;
+        if (!kv_slot_used(old, pos)) {
+            table->migrate_pos++;
+            continue;
+        }
+        kv_hash_slot_t entry = old->slots[pos];
+        kv_hash_remove_at(old, pos);
+        old->count--;
+        kv_hash_insert(table, entry, kv_slot_hash(&entry));
+    }
+    if (table->migrate_pos >= old->size) {
+        kv_hash_drop_old(table);
+    }
+}
+
+/* 开始扩容到size个槽：本表换用新数组，原数组作为旧表在之后的set/del中逐步搬移 */
+static int kv_hash_grow(kv_hash_table_t *table, uint32_t size)
+{
+    const kv_allocator_t *allocator = table->allocator;
+    kv_hash_slot_t *slots = allocator->alloc(allocator->ctx, KV_INDEX_BUF_SIZE(size));
+
+    if (slots == NULL) {
+        return -1;
+    }
+    if (table->count == 0) {
+        allocator->free(allocator->ctx, table->slots);
+        kv_hash_attach(table, slots, size);
+        return 0;
+    }
+
+    kv_hash_table_t *old = allocator->alloc(allocator->ctx, sizeof(kv_hash_table_t));
+    if (old == NULL) {
+        allocator->free(allocator->ctx, slots);
+        return -1;
+    }
+    *old = *table;
+    kv_hash_attach(table, slots, size);
+    table->old = old;
+    table->migrate_pos = 0;
+    return 0;
+}
+
+/* 确认还能再放extra个新key。固定大小的表以负载上限为上限；
+ * 可扩容的表超过负载上限时扩容，分配失败时同固定大小的表 */
+int kv_hash_reserve(kv_hash_table_t *table, uint32_t extra)
+{
+    uint32_t need = table->count + extra;
+
+    if (table->allocator == NULL || need <= KV_HASH_LOAD_LIMIT(table->size)) {
+        return (need <= KV_HASH_LOAD_LIMIT(table->size)) ? 0 : -1;
+    }
+
+    /* 上一次扩容还没搬完时先搬完 (只在一次预留大量key时发生) */
+    kv_hash_migrate(table, UINT32_MAX);
+
+    uint32_t size = table->size * 2;
+    while (KV_HASH_LOAD_LIMIT(size) < need && size < 0x80000000u) {
+        size *= 2;
+    }
+    if (kv_hash_grow(table, size) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* 在本表和扩容中的旧表里查找key，owner返回所在的表 */
+static int32_t kv_hash_locate(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                              uint8_t key_len, kv_hash_table_t **owner)
+{
+    int32_t idx = kv_hash_find(table, hash, key, key_len);
+
+    *owner = table;
+    if (idx < 0 && table->old != NULL) {
+        *owner = table->old;
+        idx = kv_hash_find(table->old, hash, key, key_len);
+    }
+    return idx;
+}
+
+/* 按偏移在本表和旧表里查找key的槽，不存在返回NULL */
+static kv_hash_slot_t *kv_hash_slot_at_offset(const kv_hash_table_t *table, uint32_t hash,
+                                              uint32_t offset)
+{
+    int32_t idx = kv_hash_find_offset(table, hash, offset);
+
+    if (idx >= 0) {
+        return &table->slots[idx];
+    }
+    if (table->old != NULL && (idx = kv_hash_find_offset(table->old, hash, offset)) >= 0) {
+        return &table->old->slots[idx];
+    }
+    return NULL;
+}
+
+/* 哈希表查找 */
+int kv_hash_get(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                uint32_t *offset)
+{
+    return kv_hash_get_hashed(table, kv_hash_key(key, key_len), key, key_len, offset);
+}
+
+int kv_hash_get_hashed(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                       uint8_t key_len, uint32_t *offset)
+{
+    kv_hash_table_t *owner;
+    int32_t idx = kv_hash_locate(table, hash, key, key_len, &owner);
+
+    if (idx < 0) {
+        return -1;
+    }
+    *offset = owner->slots[idx].flash_offset;
+    return 0;
+}
+
 /* 哈希表插入/更新 */
 int kv_hash_set(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
-                uint32_t offset)
+                uint32_t offset, uint32_t *old_offset)
 {
-    uint16_t hash = kv_hash_djb2(key, key_len);
+    return kv_hash_set_hashed(table, kv_hash_key(key, key_len), key, key_len,
+                              offset, old_offset);
+}
 
-    for (int i = 0; i < FLASH_KV_HASH_SIZE; i++) {
-        uint16_t idx = (hash + i) & (FLASH_KV_HASH_SIZE - 1);
-        kv_hash_slot_t *slot = &table->slots[idx];
+int kv_hash_set_hashed(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                       uint8_t key_len, uint32_t offset, uint32_t *old_offset)
+{
+    kv_hash_table_t *owner;
 
-        if (slot->key_len == 0 || (slot->key_len == key_len &&
-            memcmp(slot->key, key, key_len) == 0)) {
-            slot->key_len = key_len;
-            memcpy(slot->key, key, key_len);
-            slot->flash_offset = offset;
-            if (slot->key_len == 0) {
-                table->count++;
-            }
-            return 0;
+    kv_hash_migrate(table, KV_HASH_MIGRATE_STEP);
+    int32_t idx = kv_hash_locate(table, hash, key, key_len, &owner);
+
+    if (old_offset != NULL) {
+        *old_offset = 0;
+    }
+
+    if (idx >= 0) {
+        if (old_offset != NULL) {
+            *old_offset = owner->slots[idx].flash_offset;
         }
+        owner->slots[idx].flash_offset = offset;
+        return 0;
     }
-    return -1;
+
+    if (kv_hash_reserve(table, 1) != 0) {
+        return -1;
+    }
+    kv_hash_slot_t entry;
+    memset(&entry, 0, sizeof(entry));
+    kv_slot_fill(&entry, hash, key, key_len);
+    entry.flash_offset = offset;
+    kv_hash_insert(table, entry, hash);
+    table->count++;
+    return 0;
 }
 
 /* 哈希表删除 */
-int kv_hash_del(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len)
+int kv_hash_del(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                uint32_t *old_offset)
 {
-    uint16_t hash = kv_hash_djb2(key, key_len);
+    return kv_hash_del_hashed(table, kv_hash_key(key, key_len), key, key_len, old_offset);
+}
 
-    for (int i = 0; i < FLASH_KV_HASH_SIZE; i++) {
-        uint16_t idx = (hash + i) & (FLASH_KV_HASH_SIZE - 1);
-        kv_hash_slot_t *slot = &table->slots[idx];
+int kv_hash_del_hashed(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                       uint8_t key_len, uint32_t *old_offset)
+{
+    kv_hash_table_t *owner;
 
-        if (slot->key_len == 0) {
-            return -1;
-        }
+    kv_hash_migrate(table, KV_HASH_MIGRATE_STEP);
+    int32_t idx = kv_hash_locate(table, hash, key, key_len, &owner);
 
-        if (slot->key_len == key_len && memcmp(slot->key, key, key_len) == 0) {
-            slot->key_len = 0;
-            memset(slot->key, 0, FLASH_KV_KEY_SIZE);  /* 清除key数据 */
-            table->count--;
-            return 0;
+    if (idx < 0) {
+        return -1;
+    }
+    if (old_offset != NULL) {
+        *old_offset = owner->slots[idx].flash_offset;
+    }
+    kv_hash_remove_at(owner, (uint32_t)idx);
+    if (owner != table) {
+        owner->count--;
+    }
+    table->count--;
+    return 0;
+}
+
+/* 索引中key是否指向offset，只比较偏移和指纹/key，不读取Flash */
+bool kv_hash_points_to(const kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                       uint32_t offset)
+{
+    uint32_t hash = kv_hash_key(key, key_len);
+    const kv_hash_slot_t *slot = kv_hash_slot_at_offset(table, hash, offset);
+
+    return slot != NULL && kv_slot_is(slot, hash, key, key_len);
+}
+
+/* key指向old_offset时原地改为new_offset，只比较偏移和指纹/key，不读取Flash */
+int kv_hash_relocate(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                     uint32_t old_offset, uint32_t new_offset)
+{
+    uint32_t hash = kv_hash_key(key, key_len);
+    kv_hash_slot_t *slot = kv_hash_slot_at_offset(table, hash, old_offset);
+
+    if (slot == NULL || !kv_slot_is(slot, hash, key, key_len)) {
+        return -1;
+    }
+    slot->flash_offset = new_offset;
+    return 0;
+}
+
+/* 探测长度统计：每个条目查找时检查的槽数 (到探测起点的距离+1)，包括扩容中的旧表 */
+void kv_hash_probe_stats(const kv_hash_table_t *table, uint32_t *max_probe,
+                         uint32_t *total_probe)
+{
+    uint32_t mask = table->size - 1;
+
+    if (table->old != NULL) {
+        kv_hash_probe_stats(table->old, max_probe, total_probe);
+    } else {
+        *max_probe = 0;
+        *total_probe = 0;
+    }
+    for (uint32_t i = 0; i < table->size; i++) {
+        if (!kv_slot_used(table, i)) {
+            continue;
+        }
+        uint32_t probe = ((i - kv_slot_hash(&table->slots[i])) & mask) + 1;
+        *total_probe += probe;
+        if (probe > *max_probe) {
+            *max_probe = probe;
         }
     }
-    return -1;
 }
+
+/* 本表和扩容中旧表的总槽数，kv_hash_entry_at的下标范围 */
+uint32_t kv_hash_slot_count(const kv_hash_table_t *table)
+{
+    return table->size + ((table->old != NULL) ? table->old->size : 0);
+}
+
+/* 读取指定槽，size之后的下标对应旧表 */
+int kv_hash_entry_at(const kv_hash_table_t *table, uint32_t idx,
+                     uint32_t *fingerprint, uint32_t *offset)
+{
+    if (idx >= table->size && table->old != NULL) {
+        return kv_hash_entry_at(table->old, idx - table->size, fingerprint, offset);
+    }
+    if (idx >= table->size || !kv_slot_used(table, idx)) {
+        return -1;
+    }
+
+    *fingerprint = kv_slot_hash(&table->slots[idx]);
+    *offset = table->slots[idx].flash_offset;
+    return 0;
+}
+
+#if FLASH_KV_INDEX_FINGERPRINT
+/* 按指纹插入 */
+int kv_hash_load(kv_hash_table_t *table, uint32_t fingerprint, uint32_t offset)
+{
+    kv_hash_slot_t entry;
+
+    kv_hash_migrate(table, KV_HASH_MIGRATE_STEP);
+    if (kv_hash_reserve(table, 1) != 0) {
+        return -1;
+    }
+    entry.fingerprint = fingerprint;
+    entry.flash_offset = offset;
+    kv_hash_insert(table, entry, fingerprint);
+    table->count++;
+    return 0;
+}
+#endif
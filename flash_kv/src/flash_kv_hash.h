@@ -12,11 +12,66 @@
 
 #include "flash_kv_types.h"
 
-void kv_hash_init(kv_hash_table_t *table);
+/* key的32位哈希，算法由FLASH_KV_HASH_METHOD选择；低位决定探测起点，
+ * 高7位为控制标签，指纹模式下整个值作为指纹 */
+uint32_t kv_hash_key(const uint8_t *key, uint8_t len);
+
+/* slots为size个槽的数组 (size为2的幂)；
+ * match/ctx 仅在指纹模式下使用，用于命中指纹后比对Flash中的完整key */
+void kv_hash_init(kv_hash_table_t *table, kv_hash_slot_t *slots, uint32_t size,
+                  kv_hash_match_fn match, void *ctx);
+void kv_hash_clear(kv_hash_table_t *table);
+
+/* 从allocator分配size个槽初始化，接近满载时自动扩容；分配失败返回-1 */
+int kv_hash_init_alloc(kv_hash_table_t *table, const kv_allocator_t *allocator, uint32_t size,
+                       kv_hash_match_fn match, void *ctx);
+
+/* 释放分配器分配的内存，固定大小的表不做处理 */
+void kv_hash_release(kv_hash_table_t *table);
+
+/* 确认还能放入extra个新key，必要时开始扩容；放不下返回-1 */
+int kv_hash_reserve(kv_hash_table_t *table, uint32_t extra);
 int kv_hash_get(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
                 uint32_t *offset);
+
+/* old_offset (可为NULL) 返回被取代/删除的记录偏移，新插入时为0 */
 int kv_hash_set(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
-                uint32_t offset);
-int kv_hash_del(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len);
+                uint32_t offset, uint32_t *old_offset);
+int kv_hash_del(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                uint32_t *old_offset);
+
+/* 使用调用者已算好的hash (必须等于kv_hash_key(key, key_len))，省去重复计算 */
+int kv_hash_get_hashed(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                       uint8_t key_len, uint32_t *offset);
+int kv_hash_set_hashed(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                       uint8_t key_len, uint32_t offset, uint32_t *old_offset);
+int kv_hash_del_hashed(kv_hash_table_t *table, uint32_t hash, const uint8_t *key,
+                       uint8_t key_len, uint32_t *old_offset);
+
+/* 索引中key是否指向offset处的记录 (不读取Flash，用于GC判断记录是否为最新) */
+bool kv_hash_points_to(const kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                       uint32_t offset);
+
+/* 索引中key指向old_offset处的记录时改为new_offset并返回0，否则返回-1
+ * (不读取Flash，用于GC搬移记录后原地更新偏移) */
+int kv_hash_relocate(kv_hash_table_t *table, const uint8_t *key, uint8_t key_len,
+                     uint32_t old_offset, uint32_t new_offset);
+
+/* 探测长度统计：max_probe为最长的一次命中查找检查的槽数，
+ * total_probe为全部条目之和 (除以count得平均值)，遍历整个槽数组计算 */
+void kv_hash_probe_stats(const kv_hash_table_t *table, uint32_t *max_probe,
+                         uint32_t *total_probe);
+
+/* 槽总数 (扩容中包括旧表)，kv_hash_entry_at的下标范围 */
+uint32_t kv_hash_slot_count(const kv_hash_table_t *table);
+
+/* 读取第idx个槽，空槽返回-1 (用于保存索引快照) */
+int kv_hash_entry_at(const kv_hash_table_t *table, uint32_t idx,
+                     uint32_t *fingerprint, uint32_t *offset);
+
+#if FLASH_KV_INDEX_FINGERPRINT
+/* 按指纹直接插入，调用者保证key不重复 (用于加载索引快照) */
+int kv_hash_load(kv_hash_table_t *table, uint32_t fingerprint, uint32_t offset);
+#endif
 
 #endif
@@ -1,21 +1,33 @@
 /**
  * @file flash_kv_test.c
  * @brief Flash KV 单元测试
- * @description 包含12个测试用例，覆盖基础操作、类型转换、GC、事务、双区域备份等功能
+ * @description 覆盖基础操作、类型转换、GC、事务、扇区环形日志、索引、缓存等功能
+ *              新增测试按功能加入的先后顺序追加在末尾
  * @author EasyData
  * @date 2026-02-25
  * @version 1.0.0
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <time.h>
 #include "flash_kv.h"
 #include "flash_kv_utils.h"
+#include "flash_kv_crc.h"
 
 extern const flash_kv_ops_t mock_flash_ops;
 extern int mock_flash_reset(void);
+extern uint32_t mock_flash_take_read_count(void);
+extern uint32_t mock_flash_take_write_count(void);
+extern uint32_t mock_flash_take_erase_count(void);
+extern uint32_t mock_flash_take_reprogram_count(void);
+extern void mock_flash_fail_write(uint32_t n);
+extern void mock_flash_tear_write(uint32_t keep);
+extern const flash_kv_ops_t *mmap_flash_open(uint32_t size);
+extern void mmap_flash_close(void);
+extern uint32_t mmap_flash_take_read_count(void);
 
 /* 打印缓冲区内容（十六进制） */
 static void print_hex(const uint8_t *buf, uint8_t len)
@@ -40,6 +52,36 @@ static void ensure_initialized(void)
     flash_kv_init(0, &config);
 }
 
+/* 日志已占用的字节数 (日志头之前的扇区按写满计算)，应等于有效与可回收字节之和 */
+static uint32_t log_used(const kv_handle_t *handle)
+{
+    uint32_t used = 0;
+
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        if (handle->sectors[i].seq == KV_SECTOR_FREE) {
+            continue;
+        }
+        if (i == handle->head_sector) {
+            used += handle->write_offset - i * handle->block_size;
+        } else if (i == handle->cold_sector) {
+            used += handle->cold_offset - i * handle->block_size;
+        } else {
+            used += handle->block_size;
+        }
+        used -= sizeof(kv_sector_header_t);
+    }
+    return used;
+}
+
+/* key的value是否为给定字符串 */
+static bool value_is(const char *key, const char *expect)
+{
+    uint8_t buf[FLASH_KV_VALUE_SIZE];
+    uint8_t len = sizeof(buf);
+    return flash_kv_get((const uint8_t *)key, (uint8_t)strlen(key), buf, &len) == KV_OK &&
+           len == strlen(expect) && memcmp(buf, expect, len) == 0;
+}
+
 void test_kv_set_get(void)
 {
     printf("\n  [Test] KV Set/Get Basic Operations\n");
@@ -527,48 +569,2361 @@ void test_kv_transaction(void)
     printf("\n  [PASS] Transaction Test\n");
 }
 
-void test_kv_dual_region(void)
+/* 碰撞key缓冲大小："c" + 最多10位十进制 + 结尾0 */
+#define COLLISION_KEY_SIZE  12
+
+/* 找出两个32位哈希相同的短key ("c0"~"c199999"中按生日碰撞几乎必有) */
+static int hash_entry_cmp(const void *a, const void *b)
 {
-    printf("\n  [Test] KV Dual Region Backup\n");
+    const uint32_t *x = a;
+    const uint32_t *y = b;
+    return (x[0] > y[0]) - (x[0] < y[0]);
+}
 
-    /* 先清空Flash确保干净状态 */
-    flash_kv_clear();
+static void find_hash_collision(char *key_a, char *key_b)
+{
+    enum { N = 200000 };
+    static uint32_t entries[N][2];  /* {哈希, 序号} */
+    char key[COLLISION_KEY_SIZE];
+
+#if FLASH_KV_HASH_METHOD == KV_HASH_METHOD_DJB2
+    /* DJB2对短key几乎不回绕，很难随机碰撞，使用已知的一对 */
+    strcpy(key_a, "AB");
+    strcpy(key_b, "B!");
+    return;
+#endif
+
+    for (uint32_t i = 0; i < N; i++) {
+        int klen = snprintf(key, sizeof(key), "c%u", (unsigned)i);
+        entries[i][0] = flash_kv_key_hash((const uint8_t *)key, (uint8_t)klen);
+        entries[i][1] = i;
+    }
+    qsort(entries, N, sizeof(entries[0]), hash_entry_cmp);
+    for (uint32_t i = 1; i < N; i++) {
+        if (entries[i][0] == entries[i - 1][0]) {
+            snprintf(key_a, COLLISION_KEY_SIZE, "c%u", (unsigned)entries[i - 1][1]);
+            snprintf(key_b, COLLISION_KEY_SIZE, "c%u", (unsigned)entries[i][1]);
+            return;
+        }
+    }
+    assert(!"no hash collision found");
+}
+
+void test_kv_fingerprint_index(void)
+{
+    printf("\n  [Test] Index Slot Mode (fingerprint=%d)\n", FLASH_KV_INDEX_FINGERPRINT);
+
+    ensure_initialized();
+
+    printf("  [-] Slot size: %u bytes, table size: %u bytes\n",
+           (unsigned)sizeof(kv_hash_slot_t), (unsigned)sizeof(kv_hash_table_t));
+#if FLASH_KV_INDEX_FINGERPRINT
+    assert(sizeof(kv_hash_slot_t) == 8);
+#endif
+
+    /* 两个32位哈希相同的key，指纹模式下需读取Flash区分 */
+    char key_a[COLLISION_KEY_SIZE];
+    char key_b[COLLISION_KEY_SIZE];
+    find_hash_collision(key_a, key_b);
+    uint8_t len_a = (uint8_t)strlen(key_a);
+    uint8_t len_b = (uint8_t)strlen(key_b);
+    printf("  [-] \"%s\" and \"%s\" share hash 0x%08x\n", key_a, key_b,
+           (unsigned)flash_kv_key_hash((const uint8_t *)key_a, len_a));
+    int ret = flash_kv_set((const uint8_t *)key_a, len_a, (const uint8_t *)"first", 5);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)key_b, len_b, (const uint8_t *)"second", 6);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)key_a, len_a, (const uint8_t *)"first_v2", 8);
+    assert(ret == KV_OK);
+
+    uint8_t value[64];
+    uint8_t len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)key_a, len_a, value, &len);
+    assert(ret == KV_OK && len == 8 && memcmp(value, "first_v2", 8) == 0);
+    len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)key_b, len_b, value, &len);
+    assert(ret == KV_OK && len == 6 && memcmp(value, "second", 6) == 0);
+    printf("  [+] Colliding keys resolved correctly\n");
+
+    assert(flash_kv_exists((const uint8_t *)"BA", 2) == false);
+    printf("  [+] Unknown key with no stored fingerprint not found\n");
+
+    /* 超长key即使给出已存key的指纹也不能读入key缓冲比对 */
+    uint8_t long_key[255];
+    memset(long_key, 'x', sizeof(long_key));
+    memcpy(long_key, key_a, len_a);
+    uint32_t hash_a = flash_kv_key_hash((const uint8_t *)key_a, len_a);
+    len = sizeof(value);
+    assert(flash_kv_get_hashed(long_key, sizeof(long_key), hash_a, value, &len) ==
+           KV_ERR_INVALID_PARAM);
+    assert(flash_kv_get(long_key, FLASH_KV_KEY_SIZE + 1, value, &len) == KV_ERR_INVALID_PARAM);
+    assert(flash_kv_del_hashed(long_key, sizeof(long_key), hash_a) == KV_ERR_INVALID_PARAM);
+    assert(flash_kv_exists(long_key, sizeof(long_key)) == false);
+    assert(flash_kv_get(long_key, 0, value, &len) == KV_ERR_INVALID_PARAM);
+    printf("  [+] Keys longer than FLASH_KV_KEY_SIZE rejected\n");
+
+    /* GC后偏移改变，指纹比对应读取新位置 */
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)key_b, len_b, value, &len);
+    assert(ret == KV_OK && len == 6 && memcmp(value, "second", 6) == 0);
+    printf("  [+] Index valid after GC\n");
 
+    printf("\n  [PASS] Index Slot Mode Test\n");
+}
+
+void test_kv_checkpoint(void)
+{
+    printf("\n  [Test] Index Checkpoint\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 64 * 1024,
+        .block_size = 2048,
+        .checkpoint_addr = 64 * 1024,
+        .checkpoint_size = 2 * 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
     kv_handle_t *handle = flash_kv_get_handle(0);
-    assert(handle != NULL);
 
-    uint8_t active_before = handle->active_region;
-    printf("  [-] Active region before: %u\n", active_before);
+    /* 每个key写两次，日志中一半是失效记录 */
+    char key[32], value[32];
+    for (int i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "ckpt_key_%03d", i % 100);
+        snprintf(value, sizeof(value), "value_%d", i % 100);
+        ret = flash_kv_set((const uint8_t *)key, strlen(key),
+                           (const uint8_t *)value, strlen(value));
+        assert(ret == KV_OK);
+    }
 
-    /* 写入一些数据 */
-    const uint8_t region_key[] = "region_key";
-    const uint8_t region_value[] = "region_value";
-    int ret = flash_kv_set(region_key, sizeof(region_key) - 1, region_value, sizeof(region_value) - 1);
-    printf("  [-] Set key in region %u: %d\n", active_before, ret);
+    /* 写入路径只计数，到期的快照由空闲时的预擦除保存 */
+    assert(handle->ckpt_seq == 0);
+    assert(flash_kv_pre_erase(0) > 0);
+    assert(flash_kv_pre_erase(UINT32_MAX) == 0);
+    assert(handle->ckpt_seq == 1);
+    printf("  [+] Checkpoint saved by idle pre-erase, not on the write path\n");
+
+    /* 快照之后的更新需要启动时回放 */
+    for (int i = 0; i < 5; i++) {
+        snprintf(key, sizeof(key), "ckpt_key_%03d", i);
+        snprintf(value, sizeof(value), "updated_%d", i);
+        flash_kv_set((const uint8_t *)key, strlen(key),
+                     (const uint8_t *)value, strlen(value));
+    }
+
+    /* 对比不使用快照时的启动读取次数 */
+    kv_instance_config_t scan_config = config;
+    scan_config.checkpoint_size = 0;
+    mock_flash_take_read_count();
+    ret = flash_kv_init(0, &scan_config);
+    assert(ret == KV_OK);
+    uint32_t scan_reads = mock_flash_take_read_count();
+
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    uint32_t ckpt_reads = mock_flash_take_read_count();
+    printf("  [-] Boot reads: full scan=%u, checkpoint=%u\n", scan_reads, ckpt_reads);
+    assert(ckpt_reads < scan_reads);
+    assert(flash_kv_count() == 100);
+
+    uint8_t read_val[64];
+    uint8_t len;
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "ckpt_key_%03d", i);
+        snprintf(value, sizeof(value), i < 5 ? "updated_%d" : "value_%d", i);
+        len = sizeof(read_val);
+        ret = flash_kv_get((const uint8_t *)key, strlen(key), read_val, &len);
+        assert(ret == KV_OK);
+        assert(len == strlen(value) && memcmp(read_val, value, len) == 0);
+    }
+    printf("  [+] All keys restored from checkpoint + replay\n");
+
+    /* 删除标记位于快照之后，启动时回放 */
+    ret = flash_kv_del((const uint8_t *)"ckpt_key_010", 12);
+    assert(ret == KV_OK);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_exists((const uint8_t *)"ckpt_key_010", 12) == false);
+    assert(flash_kv_exists((const uint8_t *)"ckpt_key_011", 12) == true);
+    assert(flash_kv_count() == 99);
+    printf("  [+] Deleted key stays deleted after reboot\n");
+
+    /* GC后保存新快照，重启后仍可加载 */
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_count() == 99);
+    len = sizeof(read_val);
+    ret = flash_kv_get((const uint8_t *)"ckpt_key_002", 12, read_val, &len);
+    assert(ret == KV_OK && len == 9 && memcmp(read_val, "updated_2", 9) == 0);
+    printf("  [+] Checkpoint written by GC is usable\n");
+
+    /* 最新快照的条目损坏时加载另一半区的较旧快照，其后的记录照常回放 */
+    uint32_t older_seq = handle->ckpt_seq;
+    ret = flash_kv_set((const uint8_t *)"ckpt_key_003", 12, (const uint8_t *)"newest", 6);
+    assert(ret == KV_OK);
+    ret = flash_kv_checkpoint();
+    assert(ret == KV_OK && handle->ckpt_seq == older_seq + 1);
+    uint8_t zeros[8] = {0};
+    mock_flash_ops.write(config.checkpoint_addr + handle->ckpt_slot * (config.checkpoint_size / 2) +
+                         sizeof(kv_checkpoint_header_t), zeros, sizeof(zeros));
+    mock_flash_take_read_count();
+    ret = flash_kv_init(0, &scan_config);
+    assert(ret == KV_OK);
+    scan_reads = mock_flash_take_read_count();
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    ckpt_reads = mock_flash_take_read_count();
+    printf("  [-] Boot reads with torn newest half: full scan=%u, older checkpoint=%u\n",
+           scan_reads, ckpt_reads);
+    assert(handle->ckpt_seq == older_seq);
+#if FLASH_KV_INDEX_FINGERPRINT
+    /* 完整key模式加载快照也要逐条读取key，GC后日志紧凑时与全量扫描相当 */
+    assert(ckpt_reads < scan_reads);
+#endif
+    assert(flash_kv_count() == 99);
+    len = sizeof(read_val);
+    ret = flash_kv_get((const uint8_t *)"ckpt_key_003", 12, read_val, &len);
+    assert(ret == KV_OK && len == 6 && memcmp(read_val, "newest", 6) == 0);
+    printf("  [+] Corrupt newest checkpoint falls back to the older half\n");
+
+    printf("\n  [PASS] Checkpoint Test\n");
+}
+
+void test_kv_scan_stops_at_log_end(void)
+{
+    printf("\n  [Test] Boot/GC Scan Stops At Log End\n");
+
+    ensure_initialized();
+
+    char key[32];
+    for (int i = 0; i < 5; i++) {
+        snprintf(key, sizeof(key), "scan_key_%d", i);
+        int ret = flash_kv_set((const uint8_t *)key, strlen(key),
+                               (const uint8_t *)&key[9], 1);
+        assert(ret == KV_OK);
+    }
 
-    uint32_t count_before_gc = flash_kv_count();
-    printf("  [-] Count before GC: %u\n", count_before_gc);
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 64 * 1024,
+        .block_size = 2048,
+    };
+    mock_flash_take_read_count();
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    uint32_t boot_reads = mock_flash_take_read_count();
+    kv_handle_t *handle = flash_kv_get_handle(0);
+    printf("  [-] Boot reads with 5 records in a 64KB partition: %u\n", boot_reads);
+    /* 每个扇区头部 + 5条记录 + 1个擦除槽 */
+    assert(boot_reads <= handle->sector_count + 6);
+    assert(flash_kv_count() == 5);
 
-    /* 触发GC来切换区域 */
     ret = flash_kv_gc();
-    printf("  [-] GC (region switch): %d\n", ret);
+    assert(ret == KV_OK);
+    uint32_t gc_reads = mock_flash_take_read_count();
+    printf("  [-] GC reads: %u\n", gc_reads);
+    /* 只读取5条记录和日志末尾，索引偏移原地更新，不再扫描搬移后的记录 */
+    assert(gc_reads <= 6);
+    assert(flash_kv_exists((const uint8_t *)"scan_key_4", 10) == true);
+
+    /* 搬移中途写入失败：已搬移的槽指向新位置，其余仍指向原扇区，重启后一致 */
+    ret = flash_kv_set((const uint8_t *)"scan_key_0", 10, (const uint8_t *)"w", 1);
+    assert(ret == KV_OK);
+    uint32_t reclaimed = handle->gc_reclaimed;
+    mock_flash_fail_write(3);
+    ret = flash_kv_gc();
+    mock_flash_fail_write(0);
+    assert(ret == KV_ERR_FLASH_FAIL);
+    assert(handle->gc_state == KV_GC_IDLE && handle->gc_reclaimed == reclaimed);
+    uint8_t value[FLASH_KV_VALUE_SIZE];
+    for (int boot = 0; boot < 2; boot++) {
+        assert(flash_kv_count() == 5);
+        for (int i = 0; i < 5; i++) {
+            snprintf(key, sizeof(key), "scan_key_%d", i);
+            uint8_t len = sizeof(value);
+            ret = flash_kv_get((const uint8_t *)key, strlen(key), value, &len);
+            assert(ret == KV_OK && len == 1 && value[0] == (i == 0 ? 'w' : key[9]));
+        }
+        ret = flash_kv_init(0, &config);
+        assert(ret == KV_OK);
+    }
+    printf("  [+] Failed GC leaves a consistent index and log\n");
+
+    printf("\n  [PASS] Scan Bound Test\n");
+}
 
-    uint8_t active_after = handle->active_region;
-    printf("  [-] Active region after GC: %u\n", active_after);
+/* 测试CRC引擎：标准校验值、分段计算与一次性计算一致 */
+void test_kv_crc_engine(void)
+{
+    printf("\n  [Test] CRC Engine\n");
+
+    const uint8_t check[] = "123456789";
+    assert(kv_crc16(check, 9) == 0x29B1);
+#if FLASH_KV_CRC32_CASTAGNOLI
+    assert(kv_crc32(check, 9) == 0xE3069283);
+#else
+    assert(kv_crc32(check, 9) == 0xFC891918);
+#endif
+    printf("  [+] Standard check values match\n");
+
+    uint8_t data[203];
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 37 + 11);
+    }
 
-    uint32_t count_after_gc = flash_kv_count();
-    printf("  [-] Count after GC: %u\n", count_after_gc);
+    /* 覆盖非8字节对齐的长度和切分点 */
+    for (uint32_t split = 0; split <= sizeof(data); split += 7) {
+        uint16_t c16 = kv_crc16_update(KV_CRC16_INIT, data, split);
+        c16 = kv_crc16_update(c16, data + split, sizeof(data) - split);
+        assert(c16 == kv_crc16(data, sizeof(data)));
+
+        uint32_t c32 = kv_crc32_update(KV_CRC32_INIT, data, split);
+        c32 = kv_crc32_update(c32, data + split, sizeof(data) - split);
+        assert(kv_crc32_final(c32) == kv_crc32(data, sizeof(data)));
+    }
+    printf("  [+] Incremental CRC matches one-shot at every split\n");
+
+    printf("\n  [PASS] CRC Engine Test\n");
+}
+
+void test_kv_variable_records(void)
+{
+    printf("\n  [Test] Variable-Length Records\n");
+
+    ensure_initialized();
+    kv_handle_t *handle = flash_kv_get_handle(0);
 
-    /* 验证数据在新区域中仍然存在 */
+    /* 6字节key + 4字节value只占用 头部 + 10字节 再按写入单位对齐 */
+    uint32_t start = handle->write_offset;
+    int ret = flash_kv_set((const uint8_t *)"uptime", 6, (const uint8_t *)"\x01\x02\x03\x04", 4);
+    assert(ret == KV_OK);
+    uint32_t small_size = handle->write_offset - start;
+    printf("  [-] Record size for 6B key + 4B value: %u bytes\n", small_size);
+    assert(small_size == KV_RECORD_SIZE(6, 4));
+    assert(small_size % FLASH_KV_WRITE_SIZE == 0);
+    assert(small_size < 32);
+
+    /* 最大长度的key和value */
+    uint8_t big_key[FLASH_KV_KEY_SIZE], big_val[FLASH_KV_VALUE_SIZE];
+    memset(big_key, 'k', sizeof(big_key));
+    for (uint32_t i = 0; i < sizeof(big_val); i++) {
+        big_val[i] = (uint8_t)i;
+    }
+    ret = flash_kv_set(big_key, sizeof(big_key), big_val, sizeof(big_val));
+    assert(ret == KV_OK);
     uint8_t value[64];
-    uint8_t len;
-    ret = flash_kv_get(region_key, sizeof(region_key) - 1, value, &len);
-    printf("  [-] Get after region switch: ret=%d, len=%d\n", ret, len);
-    if (ret == KV_OK) {
-        printf("  [-] Value: %.*s\n", len, value);
+    uint8_t len = sizeof(value);
+    ret = flash_kv_get(big_key, sizeof(big_key), value, &len);
+    assert(ret == KV_OK && len == sizeof(big_val) && memcmp(value, big_val, len) == 0);
+    printf("  [+] Max-size key/value round trip\n");
+
+    /* 64KB数据区可容纳880条小记录而无需GC (定长102字节时约600条)，
+     * 不超过内置工作区索引的负载上限 (1024槽的7/8) */
+    uint32_t reclaimed = handle->gc_reclaimed;
+    char key[32];
+    for (int i = 0; i < 880; i++) {
+        snprintf(key, sizeof(key), "n%d", i);
+        ret = flash_kv_set((const uint8_t *)key, strlen(key), (const uint8_t *)&i, 4);
+        assert(ret == KV_OK);
+    }
+    assert(handle->gc_reclaimed == reclaimed);
+    assert(flash_kv_count() == 882);
+    printf("  [+] 880 small records written without GC, log used %u sectors\n",
+           handle->sector_count - handle->free_sectors);
+
+    /* 更新后作废旧记录，重启后取最新值 */
+    ret = flash_kv_set((const uint8_t *)"uptime", 6, (const uint8_t *)"\x05", 1);
+    assert(ret == KV_OK);
+
+    /* 破坏一条记录的value，重启后该key丢失但后续记录不受影响 */
+    uint32_t bad_offset = handle->write_offset;
+    ret = flash_kv_set((const uint8_t *)"victim", 6, (const uint8_t *)"data", 4);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"after", 5, (const uint8_t *)"ok", 2);
+    assert(ret == KV_OK);
+    const uint8_t zero = 0;
+    mock_flash_ops.write(handle->base_addr + bad_offset + sizeof(kv_record_header_t) + 6,
+                         &zero, 1);
+
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 64 * 1024,
+        .block_size = 2048,
+    };
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)"uptime", 6, value, &len);
+    assert(ret == KV_OK && len == 1 && value[0] == 0x05);
+    assert(flash_kv_exists((const uint8_t *)"victim", 6) == false);
+    len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)"after", 5, value, &len);
+    assert(ret == KV_OK && len == 2 && memcmp(value, "ok", 2) == 0);
+    assert(flash_kv_count() == 883);
+    printf("  [+] Replay skips corrupted record and keeps walking\n");
+
+    /* GC按实际长度搬移：更新最早写入的一批key，使其所在扇区有可回收记录 */
+    for (int i = 0; i < 40; i++) {
+        snprintf(key, sizeof(key), "n%d", i);
+        ret = flash_kv_set((const uint8_t *)key, strlen(key), (const uint8_t *)&i, 2);
+        assert(ret == KV_OK);
+    }
+    uint32_t dead_before = handle->dead_bytes;
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    assert(handle->dead_bytes < dead_before);
+    len = sizeof(value);
+    ret = flash_kv_get(big_key, sizeof(big_key), value, &len);
+    assert(ret == KV_OK && len == sizeof(big_val) && memcmp(value, big_val, len) == 0);
+    assert(flash_kv_count() == 883);
+    printf("  [+] GC compacts variable-length records\n");
+
+    printf("\n  [PASS] Variable-Length Records Test\n");
+}
+
+void test_kv_sequence_tombstone(void)
+{
+    printf("\n  [Test] Sequence Numbers And Tombstones\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 64 * 1024,
+        .block_size = 2048,
+        .checkpoint_addr = 64 * 1024,
+        .checkpoint_size = 2 * 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    ret = flash_kv_set((const uint8_t *)"mode", 4, (const uint8_t *)"auto", 4);
+    assert(ret == KV_OK);
+    uint32_t seq = handle->next_seq;
+
+    /* 更新只追加一条新记录，不回写旧记录 */
+    mock_flash_take_write_count();
+    mock_flash_take_reprogram_count();
+    ret = flash_kv_set((const uint8_t *)"mode", 4, (const uint8_t *)"manual", 6);
+    assert(ret == KV_OK);
+    assert(mock_flash_take_write_count() == 1);
+    assert(handle->next_seq == seq + 1);
+
+    /* 删除写入删除标记，冷数据流已打开时同样只有一次编程 */
+    ret = flash_kv_set((const uint8_t *)"temp", 4, (const uint8_t *)"0", 1);
+    assert(ret == KV_OK);
+    ret = flash_kv_del((const uint8_t *)"temp", 4);
+    assert(ret == KV_OK && handle->cold_sector != KV_SECTOR_NONE);
+    ret = flash_kv_set((const uint8_t *)"temp", 4, (const uint8_t *)"1", 1);
+    assert(ret == KV_OK);
+    mock_flash_take_write_count();
+    ret = flash_kv_del((const uint8_t *)"temp", 4);
+    assert(ret == KV_OK);
+    assert(mock_flash_take_write_count() == 1);
+    assert(mock_flash_take_reprogram_count() == 0);
+    printf("  [+] Update/delete cost one program, no byte programmed twice\n");
+
+    /* 快照之后的删除和更新，重启后回放 */
+    ret = flash_kv_checkpoint();
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"temp", 4, (const uint8_t *)"2", 1);
+    assert(ret == KV_OK);
+    ret = flash_kv_del((const uint8_t *)"mode", 4);
+    assert(ret == KV_OK);
+    seq = handle->next_seq;
+
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_exists((const uint8_t *)"mode", 4) == false);
+    uint8_t value[64];
+    uint8_t len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)"temp", 4, value, &len);
+    assert(ret == KV_OK && len == 1 && value[0] == '2');
+    assert(flash_kv_count() == 1);
+    assert(handle->next_seq == seq);
+    printf("  [+] Tombstones and updates replayed, next seq=%u\n", handle->next_seq);
+
+    /* GC只保留最新记录 (搬移到冷数据流)，删除标记随之丢弃 */
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    assert(handle->free_sectors == handle->sector_count - 2);
+    assert(handle->write_offset - handle->head_sector * handle->block_size ==
+           sizeof(kv_sector_header_t));
+    assert(handle->cold_offset - handle->cold_sector * handle->block_size ==
+           sizeof(kv_sector_header_t) + KV_RECORD_SIZE(4, 1));
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_count() == 1);
+    assert(flash_kv_exists((const uint8_t *)"mode", 4) == false);
+    assert(handle->next_seq == seq);
+    /* 全量扫描只能从现存记录恢复序号，仍大于日志中所有记录 */
+    config.checkpoint_size = 0;
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(handle->next_seq > 0 && handle->next_seq <= seq);
+    assert(mock_flash_take_reprogram_count() == 0);
+    printf("  [+] GC keeps only the newest version of each key\n");
+
+    printf("\n  [PASS] Sequence Numbers And Tombstones Test\n");
+}
+
+void test_kv_space_accounting(void)
+{
+    printf("\n  [Test] Live/Dead Space Accounting\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 64 * 1024,
+        .block_size = 2048,
+        .checkpoint_addr = 64 * 1024,
+        .checkpoint_size = 2 * 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+    const uint32_t s_a = KV_RECORD_SIZE(3, 10), s_b = KV_RECORD_SIZE(3, 40);
+
+    ret = flash_kv_set((const uint8_t *)"cfg", 3, (const uint8_t *)"0123456789", 10);
+    assert(ret == KV_OK);
+    assert(handle->live_bytes == s_a && handle->dead_bytes == 0);
+
+    uint8_t big[40];
+    memset(big, 'x', sizeof(big));
+    ret = flash_kv_set((const uint8_t *)"cfg", 3, big, sizeof(big));
+    assert(ret == KV_OK);
+    assert(handle->live_bytes == s_b && handle->dead_bytes == s_a);
+
+    ret = flash_kv_set((const uint8_t *)"tmp", 3, (const uint8_t *)"0123456789", 10);
+    assert(ret == KV_OK);
+    ret = flash_kv_del((const uint8_t *)"tmp", 3);
+    assert(ret == KV_OK);
+    uint32_t live = handle->live_bytes, dead = handle->dead_bytes;
+    assert(live == s_b && dead == 2 * s_a + KV_RECORD_SIZE(3, 0));
+    assert(live + dead == log_used(handle));
+    printf("  [+] live=%u dead=%u after update and delete\n", live, dead);
+
+    /* 全量扫描和快照加载后计数一致 */
+    kv_instance_config_t scan_config = config;
+    scan_config.checkpoint_size = 0;
+    ret = flash_kv_init(0, &scan_config);
+    assert(ret == KV_OK);
+    assert(handle->live_bytes == live && handle->dead_bytes == dead);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    ret = flash_kv_checkpoint();
+    assert(ret == KV_OK);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(handle->live_bytes == live && handle->dead_bytes == dead);
+    printf("  [+] Counters recovered at boot (scan and checkpoint)\n");
+
+    /* 写满有效数据：没有可回收空间时直接返回空间不足，不做无用GC */
+    char key[16];
+    uint8_t value[64];
+    memset(value, 0x5A, sizeof(value));
+    int n = 0;
+    for (;;) {
+        snprintf(key, sizeof(key), "fill%d", n);
+        ret = flash_kv_set((const uint8_t *)key, strlen(key), value, sizeof(value));
+        if (ret == KV_OK) {
+            n++;
+            continue;
+        }
+        assert(ret == KV_ERR_NO_SPACE);
+        if (handle->gc_state == KV_GC_IDLE) {
+            break;
+        }
+        /* 写满时进行中的增量GC可能尚未完成，完成后再试 */
+        while (flash_kv_gc_step(16) == KV_GC_PENDING) {
+        }
+    }
+    uint32_t reclaimed = handle->gc_reclaimed;
+    mock_flash_take_erase_count();
+    ret = flash_kv_set((const uint8_t *)"fill0", 5, value, sizeof(value));
+    assert(ret == KV_ERR_NO_SPACE);
+    assert(handle->gc_reclaimed == reclaimed && mock_flash_take_erase_count() == 0);
+    printf("  [+] %d records filled the partition, no GC without room for live data\n", n);
+
+    /* 写满后删除仍可写入删除标记，释放的容量可以再写入 */
+    for (int i = 0; i < 4; i++) {
+        snprintf(key, sizeof(key), "fill%d", i);
+        ret = flash_kv_del((const uint8_t *)key, strlen(key));
+        assert(ret == KV_OK);
+    }
+    ret = flash_kv_set((const uint8_t *)"after_gc", 8, value, sizeof(value));
+    assert(ret == KV_OK);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_exists((const uint8_t *)"fill0", 5) == false);
+    assert(flash_kv_exists((const uint8_t *)"fill4", 5) == true);
+    assert(flash_kv_count() == (uint32_t)n - 4 + 2);
+    printf("  [+] Delete on a full log frees room for new writes\n");
+
+    uint32_t total, used;
+    flash_kv_status(&total, &used);
+    assert(used == handle->live_bytes);
+
+    printf("\n  [PASS] Live/Dead Space Accounting Test\n");
+}
+
+void test_kv_multi_instance(void)
+{
+    printf("\n  [Test] Multiple Instances\n");
+
+    mock_flash_reset();
+    kv_instance_config_t hot_config = {
+        .start_addr = 0,
+        .total_size = 64 * 1024,
+        .block_size = 2048,
+    };
+    kv_instance_config_t cold_config = {
+        .start_addr = 72 * 1024,
+        .total_size = 32 * 1024,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &hot_config);
+    assert(ret == KV_OK);
+    ret = flash_kv_init(1, &cold_config);
+    assert(ret == KV_OK);
+    kv_handle_t *hot = flash_kv_get_handle(0);
+    kv_handle_t *cold = flash_kv_get_handle(1);
+    assert(hot != NULL && cold != NULL && &hot->index != &cold->index);
+
+    /* 同名key在两个实例中互不影响 */
+    ret = flash_kv_set_h(hot, (const uint8_t *)"gain", 4, (const uint8_t *)"calib", 5);
+    assert(ret == KV_OK);
+    ret = flash_kv_set_h(cold, (const uint8_t *)"gain", 4, (const uint8_t *)"factory", 7);
+    assert(ret == KV_OK);
+    ret = flash_kv_set_h(cold, (const uint8_t *)"serial", 6, (const uint8_t *)"SN0001", 6);
+    assert(ret == KV_OK);
+
+    uint8_t value[64];
+    uint8_t len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)"gain", 4, value, &len);
+    assert(ret == KV_OK && len == 5 && memcmp(value, "calib", 5) == 0);
+    len = sizeof(value);
+    ret = flash_kv_get_h(cold, (const uint8_t *)"gain", 4, value, &len);
+    assert(ret == KV_OK && len == 7 && memcmp(value, "factory", 7) == 0);
+    assert(flash_kv_exists((const uint8_t *)"serial", 6) == false);
+    assert(flash_kv_count() == 1 && flash_kv_count_h(cold) == 2);
+    printf("  [+] Same key holds different values per instance\n");
+
+    /* 热数据实例反复GC，冷数据实例不受影响 */
+    uint32_t cold_reclaimed = cold->gc_reclaimed;
+    uint32_t cold_seq = cold->sector_seq;
+    for (int i = 0; i < 3; i++) {
+        ret = flash_kv_gc_h(hot);
+        assert(ret == KV_OK);
+    }
+    ret = flash_kv_del_h(hot, (const uint8_t *)"gain", 4);
+    assert(ret == KV_OK);
+    assert(cold->gc_reclaimed == cold_reclaimed && cold->sector_seq == cold_seq);
+    assert(flash_kv_exists_h(cold, (const uint8_t *)"gain", 4) == true);
+    printf("  [+] GC and delete on one instance leave the other intact\n");
+
+    /* 事务状态按实例区分 */
+    ret = flash_kv_tx_begin_h(cold);
+    assert(ret == KV_OK);
+    assert(cold->tx_state == KV_TX_STATE_PREPARED && hot->tx_state == KV_TX_STATE_IDLE);
+    ret = flash_kv_tx_rollback_h(cold);
+    assert(ret == KV_OK);
+
+    /* 重启后各自恢复 */
+    ret = flash_kv_init(0, &hot_config);
+    assert(ret == KV_OK);
+    ret = flash_kv_init(1, &cold_config);
+    assert(ret == KV_OK);
+    assert(flash_kv_count_h(hot) == 0 && flash_kv_count_h(cold) == 2);
+    len = sizeof(value);
+    ret = flash_kv_get_h(cold, (const uint8_t *)"serial", 6, value, &len);
+    assert(ret == KV_OK && len == 6 && memcmp(value, "SN0001", 6) == 0);
+    printf("  [+] Both instances recovered independently\n");
+
+    ret = flash_kv_deinit(1);
+    assert(ret == KV_OK);
+    assert(flash_kv_get_handle(1) == NULL);
+    assert(flash_kv_set_h(cold, (const uint8_t *)"x", 1, (const uint8_t *)"y", 1) == KV_ERR_NO_INIT);
+
+    printf("\n  [PASS] Multiple Instances Test\n");
+}
+
+void test_kv_workspace(void)
+{
+    printf("\n  [Test] Caller-Provided Workspace\n");
+
+    /* 按20个key计算并由调用者提供缓冲区 */
+    kv_workspace_t ws;
+    uint32_t total = flash_kv_workspace_size(20, &ws);
+    assert(ws.index_size == KV_INDEX_BUF_SIZE(32));
+    assert(ws.io_size >= KV_IO_BUF_SIZE && total == ws.index_size + ws.io_size);
+
+    static uint32_t index_buf[KV_INDEX_BUF_SIZE(32) / 4];
+    static uint32_t io_buf[(KV_IO_BUF_SIZE + 3) / 4];
+    ws.index_buf = index_buf;
+    ws.io_buf = io_buf;
+    ws.io_size = sizeof(io_buf);
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 32 * 1024,
+        .block_size = 2048,
+        .workspace = &ws,
+    };
+    int ret = flash_kv_init(1, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(1);
+    assert(handle->index.slots == (kv_hash_slot_t *)index_buf && handle->index.size == 32);
+    assert(handle->io_buf == (uint8_t *)io_buf);
+
+    char key[16];
+    char value[32];
+    for (int i = 0; i < 20; i++) {
+        int klen = snprintf(key, sizeof(key), "ws%02d", i);
+        int vlen = snprintf(value, sizeof(value), "value-%d", i);
+        ret = flash_kv_set_h(handle, (const uint8_t *)key, (uint8_t)klen,
+                             (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+    }
+    printf("  [+] 20 keys stored in a 32-slot caller index\n");
+
+    /* 反复更新直到触发GC，索引不扩容也能完成回收 */
+    uint32_t reclaimed = handle->gc_reclaimed;
+    char last[32] = "value-5";
+    for (int round = 0; handle->gc_reclaimed == reclaimed; round++) {
+        assert(round < 2000);
+        int klen = snprintf(key, sizeof(key), "ws%02d", round % 20);
+        int vlen = snprintf(value, sizeof(value), "round-%d", round);
+        ret = flash_kv_set_h(handle, (const uint8_t *)key, (uint8_t)klen,
+                             (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+        if (round % 20 == 5) {
+            memcpy(last, value, sizeof(last));
+        }
     }
+    assert(flash_kv_count_h(handle) == 20);
+    printf("  [+] GC runs within the caller index\n");
 
-    printf("\n  [PASS] Dual Region Test\n");
+    /* 重启后从同一工作区恢复 */
+    ret = flash_kv_init(1, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_count_h(handle) == 20);
+    uint8_t buf[64];
+    uint8_t len = sizeof(buf);
+    ret = flash_kv_get_h(handle, (const uint8_t *)"ws05", 4, buf, &len);
+    assert(ret == KV_OK && len == strlen(last) && memcmp(buf, last, len) == 0);
+    printf("  [+] Data recovered after reboot\n");
+
+    /* 达到负载上限 (32槽的7/8) 时新key被拒绝，已有key仍可更新 */
+    for (int i = 20; i < 28; i++) {
+        int klen = snprintf(key, sizeof(key), "ws%02d", i);
+        ret = flash_kv_set_h(handle, (const uint8_t *)key, (uint8_t)klen,
+                             (const uint8_t *)"x", 1);
+        assert(ret == KV_OK);
+    }
+    ret = flash_kv_set_h(handle, (const uint8_t *)"overflow", 8, (const uint8_t *)"x", 1);
+    assert(ret == KV_ERR_HASH_FULL);
+    ret = flash_kv_set_h(handle, (const uint8_t *)"ws00", 4, (const uint8_t *)"y", 1);
+    assert(ret == KV_OK);
+    printf("  [+] Full index rejects new keys with HASH_FULL\n");
+
+    /* 缓冲区不足或未对齐时拒绝初始化 */
+    kv_workspace_t bad = ws;
+    bad.io_size = KV_IO_BUF_SIZE - 1;
+    config.workspace = &bad;
+    assert(flash_kv_init(1, &config) == KV_ERR_INVALID_PARAM);
+    bad = ws;
+    bad.index_buf = (uint8_t *)index_buf + 1;
+    assert(flash_kv_init(1, &config) == KV_ERR_INVALID_PARAM);
+    bad = ws;
+    bad.index_size = sizeof(kv_hash_slot_t);
+    assert(flash_kv_init(1, &config) == KV_ERR_INVALID_PARAM);
+    printf("  [+] Undersized or misaligned buffers are rejected\n");
+
+    flash_kv_deinit(1);
+    printf("\n  [PASS] Caller-Provided Workspace Test\n");
+}
+
+/* 按轮次更新k00..k39，直到空闲空间降到阈值以下、空闲任务的一步开始回收 */
+static void gc_step_fill(kv_handle_t *handle, int *round)
+{
+    char key[16];
+    char value[32];
+
+    while (flash_kv_gc_step(1) == KV_OK && handle->gc_state == KV_GC_IDLE) {
+        for (int i = 0; i < 40; i++) {
+            int klen = snprintf(key, sizeof(key), "k%02d", i);
+            int vlen = snprintf(value, sizeof(value), "r%d-%d", *round, i);
+            int ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen,
+                                   (const uint8_t *)value, (uint8_t)vlen);
+            assert(ret == KV_OK);
+        }
+        (*round)++;
+    }
+}
+
+static void gc_step_check(int round)
+{
+    char key[16];
+    char expect[32];
+    uint8_t value[64];
+
+    for (int i = 0; i < 40; i++) {
+        int klen = snprintf(key, sizeof(key), "k%02d", i);
+        int vlen = snprintf(expect, sizeof(expect), "r%d-%d", round, i);
+        uint8_t len = sizeof(value);
+        int ret = flash_kv_get((const uint8_t *)key, (uint8_t)klen, value, &len);
+        assert(ret == KV_OK && len == vlen && memcmp(value, expect, len) == 0);
+    }
+}
+
+void test_kv_gc_step(void)
+{
+    printf("\n  [Test] Incremental GC Steps\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 32 * 1024,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    /* 没有可回收空间时不开始 */
+    assert(flash_kv_gc_step(4) == KV_OK && handle->gc_state == KV_GC_IDLE);
+
+    /* 最早写入且不再更新的记录位于最旧的扇区，最先被搬移 */
+    ret = flash_kv_set((const uint8_t *)"early_a", 7, (const uint8_t *)"a0", 2);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"early_b", 7, (const uint8_t *)"b0", 2);
+    assert(ret == KV_OK);
+    int round = 0;
+    gc_step_fill(handle, &round);
+
+    /* 每步最多一条记录的读取和搬移 (打开新扇区时多一次头部写入) 或一次擦除 */
+    uint32_t reclaimed = handle->gc_reclaimed;
+    uint32_t victim_start = handle->gc_victim * handle->block_size;
+    uint32_t steps = 1;
+    mock_flash_take_read_count();
+    mock_flash_take_write_count();
+    mock_flash_take_erase_count();
+    while (handle->gc_scan_offset < victim_start + 256) {
+        ret = flash_kv_gc_step(1);
+        assert(ret == KV_GC_PENDING);
+        assert(mock_flash_take_read_count() <= 1 && mock_flash_take_write_count() <= 2);
+        assert(mock_flash_take_erase_count() <= 1);
+        steps++;
+    }
+    assert(handle->gc_reclaimed == reclaimed);
+
+    /* GC进行中照常读写：已搬移的key被更新/删除，新key写入日志头 */
+    uint8_t value[64];
+    uint8_t len = sizeof(value);
+    ret = flash_kv_get((const uint8_t *)"early_a", 7, value, &len);
+    assert(ret == KV_OK && len == 2 && memcmp(value, "a0", 2) == 0);
+    ret = flash_kv_set((const uint8_t *)"early_a", 7, (const uint8_t *)"a1", 2);
+    assert(ret == KV_OK);
+    ret = flash_kv_del((const uint8_t *)"early_b", 7);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"fresh", 5, (const uint8_t *)"f", 1);
+    assert(ret == KV_OK);
+    gc_step_check(round - 1);
+
+    while ((ret = flash_kv_gc_step(1)) == KV_GC_PENDING) {
+        steps++;
+    }
+    assert(ret == KV_OK && handle->gc_state == KV_GC_IDLE);
+    assert(handle->gc_reclaimed == reclaimed + 1);
+    assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    printf("  [-] GC finished in %u steps\n", steps);
+    printf("  [+] Reads and writes continue while GC runs\n");
+
+    /* 重启后GC期间的更新和删除仍然有效 */
+    for (int boot = 0; boot < 2; boot++) {
+        gc_step_check(round - 1);
+        len = sizeof(value);
+        ret = flash_kv_get((const uint8_t *)"early_a", 7, value, &len);
+        assert(ret == KV_OK && len == 2 && memcmp(value, "a1", 2) == 0);
+        assert(flash_kv_exists((const uint8_t *)"early_b", 7) == false);
+        assert(flash_kv_exists((const uint8_t *)"fresh", 5) == true);
+        assert(flash_kv_count() == 42);
+        ret = flash_kv_init(0, &config);
+        assert(ret == KV_OK);
+    }
+    printf("  [+] Delete during GC survives reboot\n");
+
+    /* 没有空闲任务推进时，写入本身只做有限步GC，按剩余空间分摊搬移 */
+    char key[16];
+    char buf[32];
+    reclaimed = handle->gc_reclaimed;
+    uint32_t max_writes = 0;
+    for (int i = 0; handle->gc_reclaimed < reclaimed + handle->sector_count; i++) {
+        assert(i < 4000);
+        int klen = snprintf(key, sizeof(key), "k%02d", i % 40);
+        int vlen = snprintf(buf, sizeof(buf), "r%d-%d", round + i / 40, i % 40);
+        mock_flash_take_write_count();
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen,
+                           (const uint8_t *)buf, (uint8_t)vlen);
+        assert(ret == KV_OK);
+        uint32_t writes = mock_flash_take_write_count();
+        if (writes > max_writes) {
+            max_writes = writes;
+        }
+        if (i % 40 == 39) {
+            gc_step_check(round + i / 40);
+        }
+    }
+    printf("  [-] Max flash writes per set: %u\n", max_writes);
+    /* 每次写入只分摊当前回收扇区的一小部分搬移 */
+    assert(max_writes <= 8);
+    printf("  [+] Foreground writes drive GC in bounded steps\n");
+
+    /* 回收扇区中损坏的有效记录无法搬移：回收后丢弃指向它的槽，其他key不受影响 */
+    mock_flash_reset();
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    uint32_t bad_offset = handle->write_offset;
+    ret = flash_kv_set((const uint8_t *)"stale", 5, (const uint8_t *)"s0", 2);
+    assert(ret == KV_OK);
+    const uint8_t zero = 0;
+    mock_flash_ops.write(handle->base_addr + bad_offset + sizeof(kv_record_header_t) + 5,
+                         &zero, 1);
+    round = 0;
+    gc_step_fill(handle, &round);
+    assert(handle->gc_victim == bad_offset / handle->block_size);
+    while ((ret = flash_kv_gc_step(1)) == KV_GC_PENDING) {
+    }
+    assert(ret == KV_OK && handle->gc_state == KV_GC_IDLE);
+    assert(flash_kv_exists((const uint8_t *)"stale", 5) == false);
+    assert(flash_kv_count() == 40);
+    gc_step_check(round - 1);
+    assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    printf("  [+] Corrupted live record dropped when its sector is reclaimed\n");
+
+    printf("\n  [PASS] Incremental GC Test\n");
+}
+
+void test_kv_sector_ring(void)
+{
+    printf("\n  [Test] Sector Ring Log\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 8 * 2048,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+    assert(handle->sector_count == 8 && handle->free_sectors == 7);
+
+    /* 至少4个扇区，数据区为整数个扇区，扇区能放下最大记录 */
+    kv_instance_config_t bad = config;
+    bad.total_size = 3 * 2048;
+    assert(flash_kv_init(1, &bad) == KV_ERR_INVALID_PARAM);
+    bad.total_size = 8 * 2048 + 512;
+    assert(flash_kv_init(1, &bad) == KV_ERR_INVALID_PARAM);
+    bad.total_size = 4 * 64;
+    bad.block_size = 64;
+    assert(flash_kv_init(1, &bad) == KV_ERR_INVALID_PARAM);
+    printf("  [+] Partition geometry validated\n");
+
+    /* 冷数据只写一次，热数据反复更新，日志绕环多圈 */
+    ret = flash_kv_set((const uint8_t *)"serial", 6, (const uint8_t *)"SN0001", 6);
+    assert(ret == KV_OK);
+    char key[16], value[32];
+    uint32_t max_erases = 0;
+    int n;
+    mock_flash_take_erase_count();
+    for (n = 0; handle->gc_reclaimed < 3 * handle->sector_count; n++) {
+        assert(n < 20000);
+        int klen = snprintf(key, sizeof(key), "hot%d", n % 8);
+        int vlen = snprintf(value, sizeof(value), "v%d", n);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen,
+                           (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+        uint32_t erases = mock_flash_take_erase_count();
+        if (erases > max_erases) {
+            max_erases = erases;
+        }
+        /* 空闲时总留有一个扇区给GC搬移 */
+        assert(handle->gc_state != KV_GC_IDLE || handle->free_sectors >= 1);
+        assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    }
+    printf("  [-] %d writes, %u sectors reclaimed, max erases per set: %u\n",
+           n, handle->gc_reclaimed, max_erases);
+    /* 回收扇区不在写入路径上擦除，只有打开未预擦除的日志头和冷数据流扇区时擦除 */
+    assert(max_erases <= 2);
+
+    uint8_t buf[64];
+    uint8_t len = sizeof(buf);
+    ret = flash_kv_get((const uint8_t *)"serial", 6, buf, &len);
+    assert(ret == KV_OK && len == 6 && memcmp(buf, "SN0001", 6) == 0);
+    printf("  [+] Cold record survives the churn around the ring\n");
+
+    /* 重启后按扇区序号回放，结果与运行时一致 */
+    uint32_t live = handle->live_bytes;
+    uint32_t head = handle->head_sector;
+    uint32_t write_offset = handle->write_offset;
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(handle->live_bytes == live && handle->head_sector == head &&
+           handle->write_offset == write_offset);
+    assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    assert(flash_kv_count() == 9);
+    for (int i = n - 8; i < n; i++) {
+        int klen = snprintf(key, sizeof(key), "hot%d", i % 8);
+        int vlen = snprintf(value, sizeof(value), "v%d", i);
+        len = sizeof(buf);
+        ret = flash_kv_get((const uint8_t *)key, (uint8_t)klen, buf, &len);
+        assert(ret == KV_OK && len == vlen && memcmp(buf, value, len) == 0);
+    }
+    printf("  [+] Replay follows sector sequence after reboot\n");
+
+    printf("\n  [PASS] Sector Ring Test\n");
+}
+
+void test_kv_gc_victim(void)
+{
+    printf("\n  [Test] GC Victim Selection\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 16 * 2048,
+        .block_size = 2048,
+        .checkpoint_addr = 16 * 2048,
+        .checkpoint_size = 2 * 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    /* 冷数据写满若干扇区，之后不再更新 */
+    char key[16];
+    uint8_t value[32];
+    memset(value, 0xC5, sizeof(value));
+    for (int i = 0; i < 200; i++) {
+        int klen = snprintf(key, sizeof(key), "c%03d", i);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, value, sizeof(value));
+        assert(ret == KV_OK);
+    }
+    uint32_t cold_seq[16];
+    uint32_t cold_sectors = 0;
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        /* 日志头之后还会写入热数据，不计为冷数据扇区 */
+        cold_seq[i] = (i == handle->head_sector) ? KV_SECTOR_FREE : handle->sectors[i].seq;
+        if (cold_seq[i] != KV_SECTOR_FREE) {
+            cold_sectors++;
+        }
+    }
+    assert(cold_sectors >= 4);
+
+    /* 热数据反复更新，日志绕环多圈 */
+    uint32_t written = 0;
+    int n;
+    for (n = 0; n < 3000; n++) {
+        int klen = snprintf(key, sizeof(key), "h%d", n % 8);
+        memcpy(value, &n, sizeof(n));
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, value, 16);
+        assert(ret == KV_OK);
+        written += KV_RECORD_SIZE(klen, 16);
+        assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    }
+    assert(handle->gc_reclaimed > 2 * handle->sector_count);
+
+    /* 只有末尾空隙可回收的冷数据扇区不被选中，搬移的几乎只有热数据 */
+    uint32_t cold_kept = 0;
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        if (cold_seq[i] != KV_SECTOR_FREE && handle->sectors[i].seq == cold_seq[i]) {
+            cold_kept++;
+        }
+    }
+    assert(cold_kept == cold_sectors);
+    printf("  [-] %d writes, %u sectors reclaimed, %u bytes written, %u bytes moved, "
+           "WA %u.%02u\n", n, handle->gc_reclaimed, written, handle->gc_moved,
+           (written + handle->gc_moved) / written,
+           (written + handle->gc_moved) % written * 100 / written);
+    assert(handle->gc_moved * 5 < written);
+    printf("  [+] Cold sectors skipped, write amplification stays low\n");
+
+    /* 扇区有效字节随快照保存，重启后与运行时一致 */
+    uint32_t live[16];
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        live[i] = handle->sectors[i].live;
+    }
+    ret = flash_kv_checkpoint();
+    assert(ret == KV_OK);
+    for (int pass = 0; pass < 2; pass++) {
+        kv_instance_config_t boot = config;
+        boot.checkpoint_size = (pass == 0) ? config.checkpoint_size : 0;
+        ret = flash_kv_init(0, &boot);
+        assert(ret == KV_OK);
+        for (uint32_t i = 0; i < handle->sector_count; i++) {
+            assert(handle->sectors[i].live == live[i]);
+        }
+        assert(flash_kv_count() == 208);
+    }
+    printf("  [+] Per-sector live bytes restored from checkpoint and scan\n");
+
+    /* 显式GC只回收有可回收记录的扇区，冷数据扇区保持不动 */
+    uint32_t moved = handle->gc_moved;
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    cold_kept = 0;
+    for (uint32_t i = 0; i < handle->sector_count; i++) {
+        if (cold_seq[i] != KV_SECTOR_FREE && handle->sectors[i].seq == cold_seq[i]) {
+            cold_kept++;
+        }
+    }
+    assert(cold_kept == cold_sectors);
+    printf("  [-] Explicit GC moved %u bytes, %u cold sectors untouched\n",
+           handle->gc_moved - moved, cold_kept);
+    assert(handle->gc_moved - moved < 2048);
+
+    printf("\n  [PASS] GC Victim Selection Test\n");
+}
+
+void test_kv_hot_cold_streams(void)
+{
+    printf("\n  [Test] Hot/Cold Write Streams\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 24 * 2048,
+        .block_size = 2048,
+        .checkpoint_addr = 24 * 2048,
+        .checkpoint_size = 4 * 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    /* 冷热数据交错写入，初始时同一扇区里两者混杂 */
+    char key[16];
+    uint8_t value[16];
+    memset(value, 0x3C, sizeof(value));
+    uint32_t cold_bytes = 0;
+    for (int i = 0; i < 400; i++) {
+        int klen = snprintf(key, sizeof(key), "c%03d", i);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, value, sizeof(value));
+        assert(ret == KV_OK);
+        cold_bytes += KV_RECORD_SIZE(klen, sizeof(value));
+        if (i % 20 == 0) {
+            klen = snprintf(key, sizeof(key), "h%02d", i / 20);
+            ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, value, sizeof(value));
+            assert(ret == KV_OK);
+        }
+    }
+
+    /* 热数据反复更新：冷数据被GC搬进冷数据流一次后不再与热数据混在一起 */
+    uint32_t written = 0;
+    int n;
+    for (n = 0; n < 6000; n++) {
+        int klen = snprintf(key, sizeof(key), "h%02d", n % 20);
+        memcpy(value, &n, sizeof(n));
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, value, sizeof(value));
+        assert(ret == KV_OK);
+        written += KV_RECORD_SIZE(klen, sizeof(value));
+        assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    }
+    assert(handle->gc_reclaimed > 2 * handle->sector_count);
+    printf("  [-] %d hot writes, %u sectors reclaimed, cold data %u bytes, %u bytes moved\n",
+           n, handle->gc_reclaimed, cold_bytes, handle->gc_moved);
+    assert(handle->gc_moved < cold_bytes * 3 / 2);
+    printf("  [+] Cold records moved about once\n");
+
+    /* 删除部分冷数据后继续写入，删除标记在冷数据流中，回收热扇区不会让旧值复活 */
+    for (int i = 0; i < 400; i += 4) {
+        int klen = snprintf(key, sizeof(key), "c%03d", i);
+        ret = flash_kv_del((const uint8_t *)key, (uint8_t)klen);
+        assert(ret == KV_OK);
+    }
+    for (n = 0; n < 2000; n++) {
+        int klen = snprintf(key, sizeof(key), "h%02d", n % 20);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, value, sizeof(value));
+        assert(ret == KV_OK);
+    }
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    ret = flash_kv_checkpoint();
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"h00", 3, (const uint8_t *)"last", 4);
+    assert(ret == KV_OK);
+
+    for (int pass = 0; pass < 2; pass++) {
+        kv_instance_config_t boot = config;
+        boot.checkpoint_size = (pass == 0) ? config.checkpoint_size : 0;
+        ret = flash_kv_init(0, &boot);
+        assert(ret == KV_OK);
+        assert(flash_kv_count() == 300 + 20);
+        for (int i = 0; i < 400; i++) {
+            int klen = snprintf(key, sizeof(key), "c%03d", i);
+            assert(flash_kv_exists((const uint8_t *)key, (uint8_t)klen) == (i % 4 != 0));
+        }
+        uint8_t buf[16];
+        uint8_t len = sizeof(buf);
+        ret = flash_kv_get((const uint8_t *)"h00", 3, buf, &len);
+        assert(ret == KV_OK && len == 4 && memcmp(buf, "last", 4) == 0);
+        assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    }
+    printf("  [+] Deleted keys stay deleted after checkpoint and scan reboot\n");
+
+    printf("\n  [PASS] Hot/Cold Write Streams Test\n");
+}
+
+void test_kv_pre_erase(void)
+{
+    printf("\n  [Test] Pre-Erase Of Spare Sectors\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 8 * 2048,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    /* 启动时空闲扇区状态未知，需要预擦除 */
+    mock_flash_take_erase_count();
+    assert(flash_kv_pre_erase(0) == (int)handle->free_sectors);
+    assert(flash_kv_pre_erase(2) == (int)handle->free_sectors - 2);
+    assert(flash_kv_pre_erase(UINT32_MAX) == 0);
+#if FLASH_KV_BLANK_CHECK
+    /* 新Flash已是擦除态，只检查不擦除 */
+    assert(mock_flash_take_erase_count() == 0);
+#else
+    assert(mock_flash_take_erase_count() == handle->free_sectors);
+#endif
+
+    /* 空闲任务每次写入后预擦除一个扇区，写入 (含同步回收) 从不等待擦除 */
+    char key[16], value[32];
+    uint32_t set_erases = 0;
+    int n;
+    for (n = 0; handle->gc_reclaimed < 3 * handle->sector_count; n++) {
+        assert(n < 20000);
+        int klen = snprintf(key, sizeof(key), "k%d", n % 16);
+        int vlen = snprintf(value, sizeof(value), "value-%d", n);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen,
+                           (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+        set_erases += mock_flash_take_erase_count();
+        assert(flash_kv_pre_erase(1) >= 0);
+        mock_flash_take_erase_count();
+    }
+    printf("  [-] %d writes, %u sectors reclaimed, erases on the write path: %u\n",
+           n, handle->gc_reclaimed, set_erases);
+    assert(set_erases == 0);
+
+    /* 删除后回收、未预擦除就重启：回收扇区有回收标记，不再回放，已删除的key不复活 */
+    ret = flash_kv_del((const uint8_t *)"k3", 2);
+    assert(ret == KV_OK);
+    uint32_t reclaimed = handle->gc_reclaimed;
+    for (; handle->gc_reclaimed < reclaimed + 2 * handle->sector_count; n++) {
+        int klen = snprintf(key, sizeof(key), "k%d", (n % 15) == 3 ? 15 : n % 15);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, (const uint8_t *)"x", 1);
+        assert(ret == KV_OK);
+    }
+    assert(flash_kv_pre_erase(0) > 0);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(flash_kv_exists((const uint8_t *)"k3", 2) == false);
+    assert(flash_kv_count() == 15);
+    assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+    printf("  [+] Retired sectors skipped at boot before they are erased\n");
+
+    /* 回收后、预擦除前反复重启：回收扇区不再算作已用扇区，写入一直成功，内容与模型一致 */
+    mock_flash_reset();
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    char model[48][48];
+    uint8_t model_len[48] = {0};
+    uint32_t rng = 1, reboots = 0;
+    reclaimed = 0;
+    for (n = 0; n < 6000; n++) {
+        rng = rng * 1103515245u + 12345u;
+        uint32_t k = (rng >> 16) % 48;
+        int klen = snprintf(key, sizeof(key), "r%02u", (unsigned)k);
+        if ((rng >> 8) % 4 == 0) {
+            ret = flash_kv_del((const uint8_t *)key, (uint8_t)klen);
+            assert(ret == (model_len[k] != 0 ? KV_OK : KV_ERR_NOT_FOUND));
+            model_len[k] = 0;
+        } else {
+            uint8_t vlen = (uint8_t)(1 + (rng >> 4) % 40);
+            memset(model[k], 'a' + (int)(n % 26), vlen);
+            ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, (const uint8_t *)model[k], vlen);
+            assert(ret == KV_OK);
+            model_len[k] = vlen;
+        }
+        if (n % 37 == 36) {
+            reclaimed += handle->gc_reclaimed;
+            ret = flash_kv_init(0, &config);
+            assert(ret == KV_OK);
+            assert(handle->free_sectors >= 1);
+            reboots++;
+        }
+    }
+    reclaimed += handle->gc_reclaimed;
+    for (uint32_t k = 0; k < 48; k++) {
+        int klen = snprintf(key, sizeof(key), "r%02u", (unsigned)k);
+        uint8_t buf[FLASH_KV_VALUE_SIZE];
+        uint8_t len = sizeof(buf);
+        ret = flash_kv_get((const uint8_t *)key, (uint8_t)klen, buf, &len);
+        if (model_len[k] == 0) {
+            assert(ret == KV_ERR_NOT_FOUND);
+        } else {
+            assert(ret == KV_OK && len == model_len[k] && memcmp(buf, model[k], len) == 0);
+        }
+    }
+    assert(flash_kv_gc() == KV_OK);
+    printf("  [+] %u reboots before pre-erase, %u sectors reclaimed, writes never blocked\n",
+           (unsigned)reboots, (unsigned)reclaimed);
+
+    printf("\n  [PASS] Pre-Erase Test\n");
+}
+
+void test_kv_blank_check(void)
+{
+    printf("\n  [Test] Blank Check Before Erase (enabled=%d)\n", FLASH_KV_BLANK_CHECK);
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 16 * 2048,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    /* 少量数据只占用日志头扇区，清空时其余扇区无需擦除 */
+    ret = flash_kv_set((const uint8_t *)"ip", 2, (const uint8_t *)"10.0.0.1", 8);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"mask", 4, (const uint8_t *)"255.0.0.0", 9);
+    assert(ret == KV_OK);
+    mock_flash_take_erase_count();
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    ret = flash_kv_clear();
+    assert(ret == KV_OK);
+    uint32_t erases = mock_flash_take_erase_count();
+    printf("  [-] Clear of a lightly used store: %u erases for %u sectors\n",
+           erases, handle->sector_count);
+#if FLASH_KV_BLANK_CHECK
+    assert(erases == 1);
+#else
+    assert(erases == handle->sector_count);
+#endif
+    assert(flash_kv_count() == 0);
+
+    /* 空闲扇区中有残留数据时必须擦除，之后读出为擦除态 */
+    uint32_t idx = (handle->head_sector + 2) % handle->sector_count;
+    const uint8_t junk[8] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0};
+    mock_flash_ops.write(idx * 2048 + 1000, junk, sizeof(junk));
+    handle->sectors[idx].erased = 0;
+    assert(flash_kv_pre_erase(UINT32_MAX) == 0);
+    assert(mock_flash_take_erase_count() == 1);
+    uint8_t buf[8];
+    mock_flash_ops.read(idx * 2048 + 1000, buf, sizeof(buf));
+    for (int i = 0; i < 8; i++) {
+        assert(buf[i] == 0xFF);
+    }
+    printf("  [+] Dirty spare sector erased, blank ones skipped\n");
+
+    printf("\n  [PASS] Blank Check Test\n");
+}
+
+void test_kv_batch_commit(void)
+{
+    printf("\n  [Test] Atomic Batch Commit\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 16 * 2048,
+        .block_size = 2048,
+        .checkpoint_addr = 16 * 2048,
+        .checkpoint_size = 2 * 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+
+    char key[16], value[16];
+    for (int i = 0; i < 20; i++) {
+        snprintf(key, sizeof(key), "p%02d", i);
+        int vlen = snprintf(value, sizeof(value), "old%d", i);
+        ret = flash_kv_set((const uint8_t *)key, 3, (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+    }
+
+    /* 事务内的写入先暂存，读取仍是已提交的值，提交时整批一次编程 */
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK);
+    for (int i = 0; i < 20; i++) {
+        snprintf(key, sizeof(key), "p%02d", i);
+        int vlen = snprintf(value, sizeof(value), "new%d", i);
+        ret = flash_kv_set((const uint8_t *)key, 3, (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+    }
+    assert(value_is("p00", "old0"));
+    assert(flash_kv_del((const uint8_t *)"p00", 3) == KV_ERR_TRANSACTION);
+    mock_flash_take_write_count();
+    ret = flash_kv_tx_commit();
+    assert(ret == KV_OK);
+    assert(mock_flash_take_write_count() == 1);
+    for (int i = 0; i < 20; i++) {
+        snprintf(key, sizeof(key), "p%02d", i);
+        snprintf(value, sizeof(value), "new%d", i);
+        assert(value_is(key, value));
+    }
+    assert(flash_kv_count() == 20);
+    printf("  [+] 20 staged records committed with one program\n");
+
+    /* 回滚丢弃暂存的记录；超出暂存区或扇区载荷的事务拒绝继续暂存 */
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"p00", 3, (const uint8_t *)"discard", 7);
+    assert(ret == KV_OK);
+    ret = flash_kv_tx_rollback();
+    assert(ret == KV_OK);
+    assert(value_is("p00", "new0"));
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK);
+    uint8_t big[FLASH_KV_VALUE_SIZE];
+    memset(big, 0x5A, sizeof(big));
+    int staged = 0;
+    while ((ret = flash_kv_set((const uint8_t *)"big", 3, big, sizeof(big))) == KV_OK) {
+        staged++;
+    }
+    assert(ret == KV_ERR_TRANSACTION && staged > 0);
+    ret = flash_kv_tx_rollback();
+    assert(ret == KV_OK);
+    printf("  [+] Rollback discards, oversized batch rejected after %d records\n", staged);
+
+    /* 记录写完、提交标记写入前掉电：整批不生效，之后紧接着提交的一批照常生效 */
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK);
+    uint32_t torn = 0;
+    for (int i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "p%02d", i);
+        ret = flash_kv_set((const uint8_t *)key, 3, (const uint8_t *)"torn", 4);
+        assert(ret == KV_OK);
+        torn += KV_RECORD_SIZE(3, 4);
+    }
+    mock_flash_tear_write(torn);
+    ret = flash_kv_tx_commit();
+    assert(ret == KV_ERR_FLASH_FAIL);
+    assert(value_is("p00", "new0"));
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK);
+    for (int i = 10; i < 15; i++) {
+        snprintf(key, sizeof(key), "p%02d", i);
+        ret = flash_kv_set((const uint8_t *)key, 3, (const uint8_t *)"last", 4);
+        assert(ret == KV_OK);
+    }
+    ret = flash_kv_tx_commit();
+    assert(ret == KV_OK);
+
+    /* 快照和全量扫描重启都不应用未提交的批量记录；GC搬移后仍然有效 */
+    for (int pass = 0; pass < 3; pass++) {
+        kv_instance_config_t boot = config;
+        boot.checkpoint_size = (pass == 1) ? config.checkpoint_size : 0;
+        ret = flash_kv_init(0, &boot);
+        assert(ret == KV_OK);
+        assert(flash_kv_count() == 20);
+        for (int i = 0; i < 20; i++) {
+            snprintf(key, sizeof(key), "p%02d", i);
+            if (i >= 10 && i < 15) {
+                snprintf(value, sizeof(value), "last");
+            } else {
+                snprintf(value, sizeof(value), "new%d", i);
+            }
+            assert(value_is(key, value));
+        }
+        assert(log_used(handle) == handle->live_bytes + handle->dead_bytes);
+        if (pass == 0) {
+            ret = flash_kv_gc();
+            assert(ret == KV_OK);
+        }
+    }
+    printf("  [+] Torn batch ignored after reboot, committed batches survive GC\n");
+
+    printf("\n  [PASS] Batch Commit Test\n");
+}
+
+void test_kv_bulk_get_set(void)
+{
+    printf("\n  [Test] Bulk Get/Set\n");
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 16 * 2048,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+
+    enum { N = 150 };
+    static char keys[N + 2][16];
+    static char values[N][24];
+    static uint8_t out[N + 2][FLASH_KV_VALUE_SIZE];
+    static kv_item_t items[N + 2];
+
+    /* 启动参数一次写入：相邻记录合并编程 */
+    for (int i = 0; i < N; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "boot%03d", i);
+        int vlen = snprintf(values[i], sizeof(values[i]), "param-%d", i * 7);
+        items[i].key = (const uint8_t *)keys[i];
+        items[i].key_len = 7;
+        items[i].value = (uint8_t *)values[i];
+        items[i].value_len = (uint8_t)vlen;
+    }
+    mock_flash_take_write_count();
+    ret = flash_kv_mset(items, N);
+    assert(ret == KV_OK);
+    uint32_t writes = mock_flash_take_write_count();
+    assert(writes < N / 8);
+    for (int i = 0; i < N; i++) {
+        assert(items[i].result == KV_OK);
+    }
+    assert(flash_kv_count() == N);
+    printf("  [+] %d records written with %u programs\n", N, writes);
+
+    /* 批量读取 (打乱顺序，含不存在的key和无效条目) 与逐条读取的结果一致，读取次数更少 */
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < N; i++) {
+            int k = (i * 37) % N;
+            items[i].key = (const uint8_t *)keys[k];
+            items[i].key_len = 7;
+            items[i].value = out[i];
+            items[i].value_len = 0;
+        }
+        snprintf(keys[N], sizeof(keys[N]), "missing");
+        items[N].key = (const uint8_t *)keys[N];
+        items[N].key_len = 7;
+        items[N].value = out[N];
+        items[N + 1].key = NULL;
+        items[N + 1].value = out[N + 1];
+
+        mock_flash_take_read_count();
+        ret = flash_kv_mget(items, N + 2);
+        uint32_t bulk_reads = mock_flash_take_read_count();
+        assert(ret == N);
+        for (int i = 0; i < N; i++) {
+            int k = (i * 37) % N;
+            assert(items[i].result == KV_OK);
+            assert(items[i].value_len == strlen(values[k]));
+            assert(memcmp(out[i], values[k], items[i].value_len) == 0);
+        }
+        assert(items[N].result == KV_ERR_NOT_FOUND);
+        assert(items[N + 1].result == KV_ERR_INVALID_PARAM);
+
+        for (int i = 0; i < N; i++) {
+            assert(value_is(keys[i], values[i]));
+        }
+        uint32_t single_reads = mock_flash_take_read_count();
+        uint32_t lookups = FLASH_KV_INDEX_FINGERPRINT ? N : 0;  /* 指纹命中后读取key比对 */
+        assert(bulk_reads <= lookups + N / 8 && bulk_reads < single_reads);
+        printf("  [+] mget: %u reads, get: %u reads\n", bulk_reads, single_reads);
+
+        ret = flash_kv_init(0, &config);
+        assert(ret == KV_OK);
+    }
+
+    /* 短value只写入实际长度，其余字节保持调用者的内容 */
+    ret = flash_kv_set((const uint8_t *)"tiny", 4, (const uint8_t *)"x", 1);
+    assert(ret == KV_OK);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    memset(out[0], 0xA5, sizeof(out[0]));
+    items[0].key = (const uint8_t *)"tiny";
+    items[0].key_len = 4;
+    items[0].value = out[0];
+    ret = flash_kv_mget(items, 1);
+    assert(ret == 1 && items[0].result == KV_OK && items[0].value_len == 1);
+    assert(out[0][0] == 'x');
+    for (size_t i = 1; i < sizeof(out[0]); i++) {
+        assert(out[0][i] == 0xA5);
+    }
+    printf("  [+] mget leaves bytes past the value untouched\n");
+
+    /* 事务中的批量写入逐条暂存，提交后整批生效 */
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK);
+    for (int i = 0; i < 5; i++) {
+        items[i].key = (const uint8_t *)keys[i];
+        items[i].key_len = 7;
+        items[i].value = (uint8_t *)"tx";
+        items[i].value_len = 2;
+    }
+    ret = flash_kv_mset(items, 5);
+    assert(ret == KV_OK);
+    assert(value_is(keys[0], values[0]));
+    ret = flash_kv_tx_commit();
+    assert(ret == KV_OK);
+    assert(value_is(keys[4], "tx") && value_is(keys[5], values[5]));
+
+    /* 无效条目：整批不写入 */
+    items[1].key_len = 0;
+    ret = flash_kv_mset(items, 5);
+    assert(ret == KV_ERR_INVALID_PARAM && items[1].result == KV_ERR_INVALID_PARAM);
+    printf("  [+] mset inside transaction staged, invalid item rejected\n");
+
+    printf("\n  [PASS] Bulk Get/Set Test\n");
+}
+
+void test_kv_value_cache(void)
+{
+    printf("\n  [Test] Value Cache\n");
+
+    /* 4个缓存条目 */
+    kv_workspace_t ws;
+    flash_kv_workspace_size(64, &ws);
+    static uint32_t index_buf[KV_INDEX_BUF_SIZE(128) / 4];
+    static uint32_t io_buf[(KV_IO_BUF_SIZE + 3) / 4];
+    static kv_cache_entry_t cache_buf[4];
+    ws.index_buf = index_buf;
+    ws.io_buf = io_buf;
+    ws.io_size = sizeof(io_buf);
+    ws.cache_buf = cache_buf;
+    ws.cache_size = sizeof(cache_buf);
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 8 * 2048,
+        .block_size = 2048,
+        .workspace = &ws,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+    assert(handle->cache_entries == 4);
+
+    char key[16], value[16];
+    for (int i = 0; i < 6; i++) {
+        snprintf(key, sizeof(key), "c%d", i);
+        int vlen = snprintf(value, sizeof(value), "v%d", i);
+        ret = flash_kv_set((const uint8_t *)key, 2, (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+    }
+
+    /* 第一次读取未命中，之后命中缓存不再读取记录 (指纹模式仍读取key比对) */
+    uint32_t hits, misses;
+    assert(value_is("c0", "v0"));
+    mock_flash_take_read_count();
+    for (int i = 0; i < 9; i++) {
+        assert(value_is("c0", "v0"));
+    }
+    assert(mock_flash_take_read_count() == (FLASH_KV_INDEX_FINGERPRINT ? 9u : 0u));
+    ret = flash_kv_cache_stats(&hits, &misses);
+    assert(ret == KV_OK && hits == 9 && misses == 1);
+    printf("  [+] Hot key served from RAM: %u hits, %u misses\n", hits, misses);
+
+    /* 更新和删除后不会读到缓存中的旧值；超出条目数时按CLOCK置换 */
+    ret = flash_kv_set((const uint8_t *)"c0", 2, (const uint8_t *)"new", 3);
+    assert(ret == KV_OK);
+    assert(value_is("c0", "new"));
+    for (int i = 1; i < 6; i++) {
+        snprintf(key, sizeof(key), "c%d", i);
+        snprintf(value, sizeof(value), "v%d", i);
+        assert(value_is(key, value));
+        assert(value_is(key, value));
+    }
+    ret = flash_kv_del((const uint8_t *)"c5", 2);
+    assert(ret == KV_OK);
+    uint8_t buf[FLASH_KV_VALUE_SIZE];
+    uint8_t len;
+    assert(flash_kv_get((const uint8_t *)"c5", 2, buf, &len) == KV_ERR_NOT_FOUND);
+    printf("  [+] Updates, deletes and eviction keep the cache coherent\n");
+
+    /* GC搬移记录、回收扇区后偏移被新记录重用，读取结果仍正确 */
+    uint32_t reclaimed = handle->gc_reclaimed;
+    for (int round = 0; handle->gc_reclaimed < reclaimed + 12; round++) {
+        int vlen = snprintf(value, sizeof(value), "r%d", round);
+        ret = flash_kv_set((const uint8_t *)"hot", 3, (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+        assert(value_is("hot", value));
+        assert(value_is("c1", "v1"));
+    }
+    ret = flash_kv_gc();
+    assert(ret == KV_OK);
+    assert(value_is("c0", "new"));
+    for (int i = 1; i < 5; i++) {
+        snprintf(key, sizeof(key), "c%d", i);
+        snprintf(value, sizeof(value), "v%d", i);
+        assert(value_is(key, value));
+    }
+    printf("  [+] Values stay correct across %u reclaimed sectors\n",
+           handle->gc_reclaimed - reclaimed);
+
+    /* 清空后日志从同一位置重新开始，新记录落在缓存过的偏移上 */
+    ret = flash_kv_clear();
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"c8", 2, (const uint8_t *)"before", 6);
+    assert(ret == KV_OK);
+    assert(value_is("c8", "before"));
+    ret = flash_kv_clear();
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"c9", 2, (const uint8_t *)"after", 5);
+    assert(ret == KV_OK);
+    assert(value_is("c9", "after"));
+    printf("  [+] Clear drops cached values\n");
+
+    /* 36个条目按4路组相联使用8组共32个条目，查找只比较一组 */
+    static kv_cache_entry_t large_cache[36];
+    ws.cache_buf = large_cache;
+    ws.cache_size = sizeof(large_cache);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(handle->cache_entries == 32 && handle->cache_sets == 8);
+    for (int i = 0; i < 24; i++) {
+        snprintf(key, sizeof(key), "s%d", i);
+        int vlen = snprintf(value, sizeof(value), "w%d", i);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)strlen(key),
+                           (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 24; i++) {
+            snprintf(key, sizeof(key), "s%d", i);
+            snprintf(value, sizeof(value), "w%d", i);
+            assert(value_is(key, value));
+        }
+    }
+    ret = flash_kv_cache_stats(&hits, &misses);
+    assert(ret == KV_OK && misses >= 24 && hits + misses == 48 && hits >= 12);
+    printf("  [+] Set-associative cache: %u of 24 repeat reads hit\n", hits);
+
+    /* 每组有自己的CLOCK指针：只读一次的值在各组内先进先出，不受其他组置换的影响 */
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    static int order[8][64];
+    int order_len[8] = {0};
+    for (int i = 0; i < 64; i++) {
+        snprintf(key, sizeof(key), "p%d", i);
+        int vlen = snprintf(value, sizeof(value), "x%d", i);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)strlen(key),
+                           (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+    }
+    for (int i = 0; i < 64; i++) {
+        snprintf(key, sizeof(key), "p%d", i);
+        int vlen = snprintf(value, sizeof(value), "x%d", i);
+        assert(value_is(key, value));
+        uint32_t j = 0;
+        while (j < 32 && !(large_cache[j].value_len == vlen &&
+                           memcmp(large_cache[j].value, value, (size_t)vlen) == 0)) {
+            j++;
+        }
+        assert(j < 32);
+        order[j / 4][order_len[j / 4]++] = i;
+    }
+    for (int set = 0; set < 8; set++) {
+        for (int k = (order_len[set] > 4) ? order_len[set] - 4 : 0; k < order_len[set]; k++) {
+            int vlen = snprintf(value, sizeof(value), "x%d", order[set][k]);
+            bool cached = false;
+            for (int way = 0; way < 4; way++) {
+                const kv_cache_entry_t *entry = &large_cache[set * 4 + way];
+                cached = cached || (entry->value_len == vlen &&
+                                    memcmp(entry->value, value, (size_t)vlen) == 0);
+            }
+            assert(cached);
+        }
+    }
+    printf("  [+] Each set evicts its own oldest entries\n");
+
+    flash_kv_deinit(0);
+    printf("\n  [PASS] Value Cache Test\n");
+}
+
+void test_kv_write_back(void)
+{
+    printf("\n  [Test] Write-Back Buffer\n");
+
+    /* 内置工作区没有写回缓冲时不能启用写回 */
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 8 * 2048,
+        .block_size = 2048,
+        .write_back_delay = 100,
+    };
+    assert(FLASH_KV_DIRTY_ENTRIES > 0 || flash_kv_init(0, &config) == KV_ERR_INVALID_PARAM);
+
+    kv_workspace_t ws;
+    flash_kv_workspace_size(64, &ws);
+    static uint32_t index_buf[KV_INDEX_BUF_SIZE(128) / 4];
+    static uint32_t io_buf[512 / 4];
+    static kv_dirty_entry_t dirty_buf[4];
+    static kv_cache_entry_t cache_buf[4];
+    ws.index_buf = index_buf;
+    ws.io_buf = io_buf;
+    ws.io_size = sizeof(io_buf);
+    ws.dirty_buf = dirty_buf;
+    ws.dirty_size = sizeof(dirty_buf);
+    ws.cache_buf = cache_buf;
+    ws.cache_size = sizeof(cache_buf);
+    config.workspace = &ws;
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+
+    /* 同一key高频写入只在到期时写入最后一个值 */
+    char value[16];
+    mock_flash_take_write_count();
+    for (uint32_t t = 0; t < 100; t += 2) {
+        int vlen = snprintf(value, sizeof(value), "%u", t * 30);
+        ret = flash_kv_set((const uint8_t *)"rpm", 3, (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK);
+        assert(flash_kv_poll(t) == 1);
+    }
+    assert(mock_flash_take_write_count() == 0);
+    assert(value_is("rpm", "2940") && flash_kv_exists((const uint8_t *)"rpm", 3));
+    assert(flash_kv_count() == 1);
+    assert(flash_kv_poll(100) == 0);
+    assert(mock_flash_take_write_count() == 1);
+    printf("  [+] 50 sets of one key written once after the delay\n");
+
+    /* 与Flash中相同的值不写入，包括缓冲期间改回原值 */
+    ret = flash_kv_set((const uint8_t *)"rpm", 3, (const uint8_t *)"2940", 4);
+    assert(ret == KV_OK && flash_kv_poll(100) == 0);
+    ret = flash_kv_set((const uint8_t *)"rpm", 3, (const uint8_t *)"3000", 4);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"rpm", 3, (const uint8_t *)"2940", 4);
+    assert(ret == KV_OK);
+    ret = flash_kv_flush();
+    assert(ret == KV_OK);
+    assert(mock_flash_take_write_count() == 0);
+    printf("  [+] Unchanged values skipped\n");
+
+    /* 缓冲满时先整组写入；删除只在缓冲中的key不写删除标记 */
+    char key[16];
+    for (int i = 0; i < 5; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        ret = flash_kv_set((const uint8_t *)key, 2, (const uint8_t *)"x", 1);
+        assert(ret == KV_OK);
+    }
+    assert(mock_flash_take_write_count() == 1);
+    assert(flash_kv_count() == 6);
+    ret = flash_kv_del((const uint8_t *)"k4", 2);
+    assert(ret == KV_OK);
+    assert(!flash_kv_exists((const uint8_t *)"k4", 2));
+    assert(mock_flash_take_write_count() == 0);
+    ret = flash_kv_set((const uint8_t *)"k0", 2, (const uint8_t *)"y", 1);
+    assert(ret == KV_OK);
+    ret = flash_kv_del((const uint8_t *)"k0", 2);
+    assert(ret == KV_OK);
+    assert(!flash_kv_exists((const uint8_t *)"k0", 2) && flash_kv_count() == 4);
+    printf("  [+] Full buffer flushed as one program, deletes drop buffered values\n");
+
+    /* 事务开始和卸载前写入缓冲的值 */
+    ret = flash_kv_set((const uint8_t *)"k1", 2, (const uint8_t *)"tx", 2);
+    assert(ret == KV_OK);
+    ret = flash_kv_tx_begin();
+    assert(ret == KV_OK && flash_kv_poll(100) == 0);
+    ret = flash_kv_tx_commit();
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"k2", 2, (const uint8_t *)"last", 4);
+    assert(ret == KV_OK);
+    ret = flash_kv_deinit(0);
+    assert(ret == KV_OK);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    assert(value_is("rpm", "2940") && value_is("k1", "tx") && value_is("k2", "last"));
+    assert(flash_kv_count() == 4);
+    printf("  [+] Buffered values flushed before transactions and deinit\n");
+
+    /* 删除标记写入失败时缓冲中的新值保留，不会退回Flash中的旧值 */
+    ret = flash_kv_set((const uint8_t *)"k1", 2, (const uint8_t *)"newer", 5);
+    assert(ret == KV_OK);
+    mock_flash_fail_write(1);
+    ret = flash_kv_del((const uint8_t *)"k1", 2);
+    mock_flash_fail_write(0);
+    assert(ret != KV_OK);
+    assert(value_is("k1", "newer"));
+    ret = flash_kv_del((const uint8_t *)"k1", 2);
+    assert(ret == KV_OK && !flash_kv_exists((const uint8_t *)"k1", 2));
+    ret = flash_kv_flush();
+    assert(ret == KV_OK && !flash_kv_exists((const uint8_t *)"k1", 2));
+    printf("  [+] Failed delete keeps the buffered value\n");
+
+    /* 读取缓冲区小于value时不复制，返回实际长度：写回缓冲、Flash和值缓存三条路径 */
+    ret = flash_kv_set((const uint8_t *)"long", 4, (const uint8_t *)"0123456789", 10);
+    assert(ret == KV_OK);
+    uint32_t hits, misses, hits_before;
+    assert(flash_kv_cache_stats(&hits_before, &misses) == KV_OK);
+    for (int path = 0; path < 3; path++) {
+        if (path == 1) {
+            assert(flash_kv_flush() == KV_OK);
+        }
+        uint8_t small[4];
+        uint8_t len = sizeof(small);
+        memset(small, 0xAA, sizeof(small));
+        ret = flash_kv_get((const uint8_t *)"long", 4, small, &len);
+        assert(ret == KV_ERR_BUF_TOO_SMALL && len == 10);
+        assert(small[0] == 0xAA && small[3] == 0xAA);
+        assert(flash_kv_cache_stats(&hits, &misses) == KV_OK);
+        assert(hits - hits_before == (path == 2 ? 1u : 0u));
+    }
+    assert(value_is("long", "0123456789"));
+    printf("  [+] Short read buffers rejected with the value length\n");
+
+    flash_kv_deinit(0);
+    printf("\n  [PASS] Write-Back Buffer Test\n");
+}
+
+void test_kv_get_ref(void)
+{
+    printf("\n  [Test] Zero-Copy Read\n");
+
+    /* 不支持映射的Flash不能零拷贝读取 */
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 8 * 2048,
+        .block_size = 2048,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"serial", 6, (const uint8_t *)"SN-0001", 7);
+    assert(ret == KV_OK);
+    kv_ref_t ref;
+    assert(flash_kv_get_ref((const uint8_t *)"serial", 6, &ref) == KV_ERR_INVALID_PARAM);
+
+    config.ops = mmap_flash_open(config.total_size);
+    assert(config.ops != NULL);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    ret = flash_kv_set((const uint8_t *)"serial", 6, (const uint8_t *)"SN-0001", 7);
+    assert(ret == KV_OK);
+
+    /* 引用直接指向映射的Flash，get_ref和get都不经read复制记录 */
+    mmap_flash_take_read_count();
+    ret = flash_kv_get_ref((const uint8_t *)"serial", 6, &ref);
+    assert(ret == KV_OK);
+    assert(ref.value_len == 7 && memcmp(ref.value, "SN-0001", 7) == 0);
+    assert(flash_kv_ref_valid(&ref));
+    assert(value_is("serial", "SN-0001"));
+    assert(mmap_flash_take_read_count() == (FLASH_KV_INDEX_FINGERPRINT ? 2u : 0u));
+    assert(flash_kv_get_ref((const uint8_t *)"none", 4, &ref) == KV_ERR_NOT_FOUND);
+    printf("  [+] Value referenced in place without copies\n");
+
+    /* 擦除其他扇区 (预擦除空闲扇区) 不影响引用 */
+    ret = flash_kv_get_ref((const uint8_t *)"serial", 6, &ref);
+    assert(ret == KV_OK);
+    assert(flash_kv_pre_erase(UINT32_MAX) >= 0);
+    assert(flash_kv_ref_valid(&ref));
+    printf("  [+] Reference survives erases of other sectors\n");
+
+    /* 记录所在扇区被GC回收擦除后引用失效，重新取得的引用指向搬移后的记录 */
+    const uint8_t *old_value = ref.value;
+    int writes = 0;
+    char value[16];
+    while (flash_kv_ref_valid(&ref)) {
+        int vlen = snprintf(value, sizeof(value), "%d", writes++);
+        ret = flash_kv_set((const uint8_t *)"hot", 3, (const uint8_t *)value, (uint8_t)vlen);
+        assert(ret == KV_OK && writes < 10000);
+    }
+    ret = flash_kv_get_ref((const uint8_t *)"serial", 6, &ref);
+    assert(ret == KV_OK && ref.value != old_value);
+    assert(ref.value_len == 7 && memcmp(ref.value, "SN-0001", 7) == 0);
+    printf("  [+] Reference invalidated by erase after %d writes, refreshed\n", writes);
+
+    /* 映射的记录损坏时返回CRC错误 */
+    ((uint8_t *)ref.value)[0] ^= 0x01;
+    assert(flash_kv_get_ref((const uint8_t *)"serial", 6, &ref) == KV_ERR_CRC_FAIL);
+    printf("  [+] Corrupted mapped record rejected\n");
+
+    flash_kv_deinit(0);
+    mmap_flash_close();
+    printf("\n  [PASS] Zero-Copy Read Test\n");
+}
+
+void test_kv_index_delete(void)
+{
+    printf("\n  [Test] Index Delete Keeps Probe Chains\n");
+
+    /* 64槽索引放48个key，簇很长，删除后同簇其后的key最容易查不到 */
+    kv_workspace_t ws;
+    flash_kv_workspace_size(48, &ws);
+    static uint32_t index_buf[KV_INDEX_BUF_SIZE(64) / 4];
+    static uint32_t io_buf[(KV_IO_BUF_SIZE + 3) / 4];
+    assert(ws.index_size == sizeof(index_buf));
+    ws.index_buf = index_buf;
+    ws.io_buf = io_buf;
+    ws.io_size = sizeof(io_buf);
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 32 * 1024,
+        .block_size = 2048,
+        .workspace = &ws,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+
+    char key[16];
+    bool live[48];
+    for (int i = 0; i < 48; i++) {
+        int klen = snprintf(key, sizeof(key), "idx%02d", i);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, (const uint8_t *)key, (uint8_t)klen);
+        assert(ret == KV_OK);
+        live[i] = true;
+    }
+
+    /* 随机删除和重新插入，每轮后所有key都应查得到或确实已删除 */
+    uint32_t seed = 12345;
+    uint32_t worst = 0;
+    for (int round = 0; round < 1500; round++) {
+        seed = seed * 1103515245u + 12345u;
+        int i = (int)((seed >> 16) % 48);
+        int klen = snprintf(key, sizeof(key), "idx%02d", i);
+        if (live[i]) {
+            ret = flash_kv_del((const uint8_t *)key, (uint8_t)klen);
+        } else {
+            ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen,
+                               (const uint8_t *)key, (uint8_t)klen);
+        }
+        assert(ret == KV_OK);
+        live[i] = !live[i];
+
+        if (round % 50 == 0) {
+            for (int k = 0; k < 48; k++) {
+                klen = snprintf(key, sizeof(key), "idx%02d", k);
+                assert(flash_kv_exists((const uint8_t *)key, (uint8_t)klen) == live[k]);
+            }
+        }
+        uint32_t entries, max_probe, total_probe;
+        flash_kv_index_stats(&entries, &max_probe, &total_probe);
+        if (max_probe > worst) {
+            worst = max_probe;
+        }
+    }
+    printf("  [+] 1500 deletes/inserts, every key still reachable\n");
+
+    /* 不留删除标记：探测长度与重启后按剩余key重建的索引相同 */
+    uint32_t entries, max_probe, total_probe;
+    ret = flash_kv_index_stats(&entries, &max_probe, &total_probe);
+    assert(ret == KV_OK && entries == flash_kv_count());
+    assert(max_probe >= 1 && max_probe <= entries && total_probe >= entries);
+    printf("  [-] %u keys, avg probe %u.%02u, max %u (worst seen %u)\n",
+           (unsigned)entries, (unsigned)(total_probe / entries),
+           (unsigned)(total_probe * 100 / entries % 100), (unsigned)max_probe, (unsigned)worst);
+
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    uint32_t rebuilt_entries, rebuilt_max, rebuilt_total;
+    ret = flash_kv_index_stats(&rebuilt_entries, &rebuilt_max, &rebuilt_total);
+    assert(ret == KV_OK && rebuilt_entries == entries);
+    assert(rebuilt_total == total_probe);
+    printf("  [+] Probe lengths match a freshly rebuilt index\n");
+
+    flash_kv_deinit(0);
+    printf("\n  [PASS] Index Delete Test\n");
+}
+
+void test_kv_index_load(void)
+{
+    printf("\n  [Test] Index at Load Limit\n");
+
+    /* 256槽索引放到负载上限 (87.5%，224个key)，再放新key返回HASH_FULL */
+    kv_workspace_t ws;
+    flash_kv_workspace_size(224, &ws);
+    static uint32_t index_buf[KV_INDEX_BUF_SIZE(256) / 4];
+    static uint32_t io_buf[(KV_IO_BUF_SIZE + 3) / 4];
+    assert(ws.index_size == sizeof(index_buf));
+    ws.index_buf = index_buf;
+    ws.io_buf = io_buf;
+    ws.io_size = sizeof(io_buf);
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 32 * 1024,
+        .block_size = 2048,
+        .workspace = &ws,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+
+    char key[16];
+    for (int i = 0; i < 224; i++) {
+        int klen = snprintf(key, sizeof(key), "load%03d", i);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, (const uint8_t *)key, (uint8_t)klen);
+        assert(ret == KV_OK);
+    }
+    ret = flash_kv_set((const uint8_t *)"load224", 7, (const uint8_t *)"x", 1);
+    assert(ret == KV_ERR_HASH_FULL);
+
+    /* Robin Hood使最长探测不超过两组控制标签 (32字节，在一条64字节缓存行内) */
+    uint32_t entries, max_probe, total_probe;
+    ret = flash_kv_index_stats(&entries, &max_probe, &total_probe);
+    assert(ret == KV_OK && entries == 224);
+    assert(max_probe <= 2 * KV_HASH_GROUP);
+    printf("  [-] avg probe %u.%02u, max %u\n", (unsigned)(total_probe / entries),
+           (unsigned)(total_probe * 100 / entries % 100), (unsigned)max_probe);
+
+    /* 只有标签相同的槽才比较key：命中只读取该记录，未命中不读取Flash */
+    mock_flash_take_read_count();
+    for (int i = 0; i < 224; i++) {
+        int klen = snprintf(key, sizeof(key), "load%03d", i);
+        uint8_t buf[FLASH_KV_VALUE_SIZE];
+        uint8_t len = sizeof(buf);
+        ret = flash_kv_get((const uint8_t *)key, (uint8_t)klen, buf, &len);
+        assert(ret == KV_OK && len == klen && memcmp(buf, key, len) == 0);
+    }
+    uint32_t hit_reads = mock_flash_take_read_count();
+    assert(hit_reads == 224u * (FLASH_KV_INDEX_FINGERPRINT ? 2u : 1u));
+    for (int i = 0; i < 224; i++) {
+        int klen = snprintf(key, sizeof(key), "miss%03d", i);
+        assert(!flash_kv_exists((const uint8_t *)key, (uint8_t)klen));
+    }
+    assert(mock_flash_take_read_count() == 0);
+    printf("  [+] 224 hits in %u reads, 224 misses without flash access\n", (unsigned)hit_reads);
+
+    flash_kv_deinit(0);
+    printf("\n  [PASS] Index Load Test\n");
+}
+
+void test_kv_key_hash(void)
+{
+    printf("\n  [Test] Key Hash\n");
+
+    /* 哈希值与平台无关，可以在主机上预先算好写入代码 */
+    const uint8_t key[] = "sensor.ch01.gain";
+    uint8_t key_len = sizeof(key) - 1;
+    uint32_t hash = flash_kv_key_hash(key, key_len);
+#if FLASH_KV_HASH_METHOD == KV_HASH_METHOD_WY32
+    assert(hash == 0x8edc428fu);
+#else
+    assert(hash == 0x046906e6u);
+#endif
+    printf("  [+] Known hash 0x%08x for \"%s\"\n", (unsigned)hash, key);
+
+    /* 共同前缀长的key在索引中分布均匀 (256槽放224个key) */
+    kv_workspace_t ws;
+    flash_kv_workspace_size(224, &ws);
+    static uint32_t index_buf[KV_INDEX_BUF_SIZE(256) / 4];
+    static uint32_t io_buf[(KV_IO_BUF_SIZE + 3) / 4];
+    assert(ws.index_size == sizeof(index_buf));
+    ws.index_buf = index_buf;
+    ws.io_buf = io_buf;
+    ws.io_size = sizeof(io_buf);
+
+    mock_flash_reset();
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 32 * 1024,
+        .block_size = 2048,
+        .workspace = &ws,
+    };
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+
+    char name[32];
+    for (int i = 0; i < 224; i++) {
+        int klen = snprintf(name, sizeof(name), "sensor.ch%02d.%s", i / 4,
+                            (const char *[]){"gain", "offset", "scale", "unit"}[i % 4]);
+        ret = flash_kv_set((const uint8_t *)name, (uint8_t)klen, (const uint8_t *)"1", 1);
+        assert(ret == KV_OK);
+    }
+    uint32_t entries, max_probe, total_probe;
+    ret = flash_kv_index_stats(&entries, &max_probe, &total_probe);
+    assert(ret == KV_OK && entries == 224);
+#if FLASH_KV_HASH_METHOD == KV_HASH_METHOD_WY32
+    /* 随机哈希在87.5%负载下线性探测平均约4.5次 */
+    assert(total_probe <= entries * 5);
+#endif
+    printf("  [-] 224 prefixed keys: avg probe %u.%02u, max %u\n",
+           (unsigned)(total_probe / entries), (unsigned)(total_probe * 100 / entries % 100),
+           (unsigned)max_probe);
+
+    /* _hashed接口与普通接口操作同一条目 */
+    ret = flash_kv_set_hashed(key, key_len, hash, (const uint8_t *)"1.25", 4);
+    assert(ret == KV_OK);
+    uint8_t value[FLASH_KV_VALUE_SIZE];
+    uint8_t len = sizeof(value);
+    ret = flash_kv_get(key, key_len, value, &len);
+    assert(ret == KV_OK && len == 4 && memcmp(value, "1.25", 4) == 0);
+    ret = flash_kv_set(key, key_len, (const uint8_t *)"1.50", 4);
+    assert(ret == KV_OK);
+    len = sizeof(value);
+    ret = flash_kv_get_hashed(key, key_len, hash, value, &len);
+    assert(ret == KV_OK && len == 4 && memcmp(value, "1.50", 4) == 0);
+    ret = flash_kv_del_hashed(key, key_len, hash);
+    assert(ret == KV_OK);
+    assert(!flash_kv_exists(key, key_len));
+    len = sizeof(value);
+    assert(flash_kv_get_hashed(key, key_len, hash, value, &len) == KV_ERR_NOT_FOUND);
+    assert(flash_kv_del_hashed(key, key_len, hash) == KV_ERR_NOT_FOUND);
+    printf("  [+] Precomputed-hash set/get/del match the plain API\n");
+
+    flash_kv_deinit(0);
+    printf("\n  [PASS] Key Hash Test\n");
+}
+
+/* 测试用分配器：统计分配/释放次数，limit限制同时占用的字节数 */
+typedef struct {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t in_use;
+    uint32_t limit;
+} test_heap_t;
+
+static void *test_heap_alloc(void *ctx, uint32_t size)
+{
+    test_heap_t *heap = ctx;
+    if (heap->in_use + size > heap->limit) {
+        return NULL;
+    }
+    uint32_t *block = malloc(size + sizeof(uint64_t));
+    assert(block != NULL);
+    block[0] = size;
+    heap->in_use += size;
+    heap->allocs++;
+    return (uint8_t *)block + sizeof(uint64_t);
+}
+
+static void test_heap_free(void *ctx, void *ptr)
+{
+    test_heap_t *heap = ctx;
+    uint32_t *block = (uint32_t *)((uint8_t *)ptr - sizeof(uint64_t));
+    heap->in_use -= block[0];
+    heap->frees++;
+    free(block);
+}
+
+void test_kv_index_growth(void)
+{
+    printf("\n  [Test] Index Growth\n");
+
+    /* 2000个key写入最小的可扩容索引 (16槽)，256KB数据区之后是快照区 */
+    test_heap_t heap = { .limit = UINT32_MAX };
+    kv_allocator_t allocator = { test_heap_alloc, test_heap_free, &heap };
+    kv_instance_config_t config = {
+        .start_addr = 0,
+        .total_size = 32 * 8192,
+        .block_size = 8192,
+        .checkpoint_addr = 32 * 8192,
+        .checkpoint_size = 2 * 32768,
+        .allocator = &allocator,
+    };
+    config.ops = mmap_flash_open(config.total_size + config.checkpoint_size);
+    assert(config.ops != NULL);
+    int ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    kv_handle_t *handle = flash_kv_get_handle(0);
+    assert(handle->index.size == KV_HASH_GROUP);
+
+    /* 扩容后旧表在之后的多次set中逐步搬完，搬移期间查找和删除两张表都覆盖 */
+    char key[16];
+    uint32_t growths = 0, migrate_ops = 0, max_migrate_ops = 0;
+    for (int i = 0; i < 2000; i++) {
+        int klen = snprintf(key, sizeof(key), "g%05d", i);
+        bool migrating = handle->index.old != NULL;
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, (const uint8_t *)key, (uint8_t)klen);
+        assert(ret == KV_OK);
+        if (!migrating && handle->index.old != NULL) {
+            growths++;
+            migrate_ops = 0;
+        }
+        if (handle->index.old != NULL) {
+            migrate_ops++;
+        } else if (migrate_ops > max_migrate_ops) {
+            max_migrate_ops = migrate_ops;
+        }
+        if (i % 3 == 0 && handle->index.old != NULL) {
+            int old = i / 2;
+            klen = snprintf(key, sizeof(key), "g%05d", old);
+            assert(flash_kv_exists((const uint8_t *)key, (uint8_t)klen) == (old % 7 != 3));
+        }
+        if (i % 7 == 6) {
+            klen = snprintf(key, sizeof(key), "g%05d", i - 3);
+            assert(flash_kv_del((const uint8_t *)key, (uint8_t)klen) == KV_OK);
+            assert(!flash_kv_exists((const uint8_t *)key, (uint8_t)klen));
+        }
+    }
+    uint32_t entries, max_probe, total_probe;
+    ret = flash_kv_index_stats(&entries, &max_probe, &total_probe);
+    assert(ret == KV_OK && entries == 2000 - 2000 / 7);
+    assert(handle->index.size == 2048 && growths == 7 && max_migrate_ops > 1);
+    printf("  [-] %u keys, %u slots after %u growths, longest migration %u sets\n",
+           (unsigned)entries, (unsigned)handle->index.size, (unsigned)growths,
+           (unsigned)max_migrate_ops);
+
+    for (int i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "g%05d", i);
+        bool deleted = (i % 7 == 3 && i + 3 < 2000);
+        if (deleted) {
+            assert(!flash_kv_exists((const uint8_t *)key, 6));
+        } else {
+            assert(value_is(key, key));
+        }
+    }
+    printf("  [+] Lookups and deletes correct while the old table drains\n");
+
+    /* 重启时按快照条目数或回放直接扩到所需大小 */
+    ret = flash_kv_checkpoint();
+    assert(ret == KV_OK);
+    for (int pass = 0; pass < 2; pass++) {
+        kv_instance_config_t boot = config;
+        boot.checkpoint_size = (pass == 0) ? config.checkpoint_size : 0;
+        ret = flash_kv_init(0, &boot);
+        assert(ret == KV_OK);
+        handle = flash_kv_get_handle(0);
+        assert(handle->index.count == entries);
+        for (int i = 0; i < 2000; i += 5) {
+            snprintf(key, sizeof(key), "g%05d", i);
+            assert(flash_kv_exists((const uint8_t *)key, 6) == (i % 7 != 3 || i + 3 >= 2000));
+        }
+    }
+    flash_kv_deinit(0);
+    assert(heap.allocs == heap.frees && heap.in_use == 0);
+    printf("  [+] Rebuilt from checkpoint and log scan, %u allocations all freed\n",
+           (unsigned)heap.allocs);
+
+    /* 分配失败时留在原表中放到负载上限 (7/8)，之后只能更新已有key */
+    mmap_flash_close();
+    config.ops = mmap_flash_open(config.total_size + config.checkpoint_size);
+    assert(config.ops != NULL);
+    heap.limit = KV_INDEX_BUF_SIZE(KV_HASH_GROUP);
+    ret = flash_kv_init(0, &config);
+    assert(ret == KV_OK);
+    int stored = 0;
+    for (;;) {
+        int klen = snprintf(key, sizeof(key), "f%05d", stored);
+        ret = flash_kv_set((const uint8_t *)key, (uint8_t)klen, (const uint8_t *)"1", 1);
+        if (ret != KV_OK) {
+            break;
+        }
+        stored++;
+    }
+    assert(ret == KV_ERR_HASH_FULL && stored == KV_HASH_GROUP - KV_HASH_GROUP / 8);
+    assert(flash_kv_set((const uint8_t *)"f00000", 6, (const uint8_t *)"2", 1) == KV_OK);
+    assert(value_is("f00000", "2"));
+    assert(flash_kv_del((const uint8_t *)"f00001", 6) == KV_OK);
+    assert(flash_kv_set((const uint8_t *)key, 6, (const uint8_t *)"1", 1) == KV_OK);
+    flash_kv_deinit(0);
+    assert(heap.allocs == heap.frees && heap.in_use == 0);
+    printf("  [+] Failed growth keeps the index usable, full index returns HASH_FULL\n");
+
+    mmap_flash_close();
+    printf("\n  [PASS] Index Growth Test\n");
 }
 
 int main(void)
@@ -592,7 +2947,30 @@ int main(void)
     test_kv_status();
     test_kv_gc();
     test_kv_transaction();
-    test_kv_dual_region();
+    test_kv_fingerprint_index();
+    test_kv_checkpoint();
+    test_kv_scan_stops_at_log_end();
+    test_kv_crc_engine();
+    test_kv_variable_records();
+    test_kv_sequence_tombstone();
+    test_kv_space_accounting();
+    test_kv_multi_instance();
+    test_kv_workspace();
+    test_kv_gc_step();
+    test_kv_sector_ring();
+    test_kv_gc_victim();
+    test_kv_hot_cold_streams();
+    test_kv_pre_erase();
+    test_kv_blank_check();
+    test_kv_batch_commit();
+    test_kv_bulk_get_set();
+    test_kv_value_cache();
+    test_kv_write_back();
+    test_kv_get_ref();
+    test_kv_index_delete();
+    test_kv_index_load();
+    test_kv_key_hash();
+    test_kv_index_growth();
 
     /* 压力测试单独运行，因为它需要重置Flash */
     ensure_initialized();
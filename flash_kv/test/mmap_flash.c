@@ -0,0 +1,120 @@
+/**
+ * @file mmap_flash.c
+ * @brief 文件映射Flash驱动 (用于测试)
+ * @description 用mmap把临时文件映射到内存，模拟可直接寻址的片内Flash，
+ *             提供map接口用于测试零拷贝读取；写入和擦除按NOR Flash语义
+ * @author EasyData
+ * @date 2026-02-25
+ * @version 1.0.0
+ */
+
+/* mkstemp/ftruncate/mmap在严格C标准模式下需要POSIX声明 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "flash_kv_config.h"
+#include "flash_kv_types.h"
+
+static uint8_t *g_map = NULL;
+static uint32_t g_size = 0;
+static uint32_t g_read_count = 0;   /* read调用次数 (经map读取的不计) */
+
+static int mmap_flash_init(void)
+{
+    return (g_map != NULL) ? 0 : -1;
+}
+
+static int mmap_flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    g_read_count++;
+    if (addr + len > g_size) {
+        return -1;
+    }
+    memcpy(buf, g_map + addr, len);
+    return 0;
+}
+
+static int mmap_flash_write(uint32_t addr, const uint8_t *buf, uint32_t len)
+{
+    if (addr + len > g_size) {
+        return -1;
+    }
+    /* 模拟Flash写入: 只能将1写成0 */
+    for (uint32_t i = 0; i < len; i++) {
+        g_map[addr + i] &= buf[i];
+    }
+    return 0;
+}
+
+static int mmap_flash_erase(uint32_t addr, uint32_t len)
+{
+    uint32_t start = addr / FLASH_KV_BLOCK_SIZE * FLASH_KV_BLOCK_SIZE;
+    uint32_t end = (addr + len + FLASH_KV_BLOCK_SIZE - 1) / FLASH_KV_BLOCK_SIZE *
+                   FLASH_KV_BLOCK_SIZE;
+    if (end > g_size) {
+        return -1;
+    }
+    memset(g_map + start, 0xFF, end - start);
+    return 0;
+}
+
+static const uint8_t *mmap_flash_map(uint32_t addr, uint32_t len)
+{
+    return (addr + len <= g_size) ? g_map + addr : NULL;
+}
+
+static const flash_kv_ops_t mmap_flash_ops = {
+    .init   = mmap_flash_init,
+    .read   = mmap_flash_read,
+    .write  = mmap_flash_write,
+    .erase  = mmap_flash_erase,
+    .map    = mmap_flash_map,
+};
+
+/* 创建size字节的映射Flash (临时文件，全0xFF)，失败返回NULL */
+const flash_kv_ops_t *mmap_flash_open(uint32_t size)
+{
+    char path[] = "/tmp/flash_kv_mmap_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(path);
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    g_map = map;
+    g_size = size;
+    g_read_count = 0;
+    memset(g_map, 0xFF, size);
+    return &mmap_flash_ops;
+}
+
+void mmap_flash_close(void)
+{
+    if (g_map != NULL) {
+        munmap(g_map, g_size);
+        g_map = NULL;
+        g_size = 0;
+    }
+}
+
+uint32_t mmap_flash_take_read_count(void)
+{
+    uint32_t count = g_read_count;
+    g_read_count = 0;
+    return count;
+}
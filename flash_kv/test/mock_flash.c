@@ -18,6 +18,12 @@ typedef struct {
     uint8_t *memory;
     uint32_t size;
     uint32_t block_size;
+    uint32_t read_count;    /* read调用次数，用于统计启动开销 */
+    uint32_t write_count;   /* write调用次数 */
+    uint32_t erase_count;   /* 擦除的块数 */
+    uint32_t reprogram;     /* 写入非擦除态字节的次数 (ECC Flash不允许) */
+    uint32_t fail_after;    /* 再成功写入n次后写入失败，0表示不注入故障 */
+    uint32_t tear_keep;     /* 非0时下一次write只编程前n-1字节后失败 (模拟写入中途掉电) */
 } mem_flash_t;
 
 static mem_flash_t g_flash = {0};
@@ -29,7 +35,7 @@ static int mem_flash_init(void)
         return 0;
     }
 
-    g_flash.size = 64 * 1024;  /* 64KB for testing */
+    g_flash.size = 128 * 1024;  /* 64KB数据区 + 索引快照区等 */
     g_flash.block_size = FLASH_KV_BLOCK_SIZE;
     g_flash.memory = malloc(g_flash.size);
     if (g_flash.memory == NULL) {
@@ -51,6 +57,7 @@ static int mem_flash_reset(void)
 
 static int mem_flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
 {
+    g_flash.read_count++;
     if (addr + len > g_flash.size) {
         return -1;
     }
@@ -63,8 +70,23 @@ static int mem_flash_write(uint32_t addr, const uint8_t *buf, uint32_t len)
     if (addr + len > g_flash.size) {
         return -1;
     }
+    if (g_flash.fail_after != 0 && --g_flash.fail_after == 0) {
+        return -1;
+    }
+    if (g_flash.tear_keep != 0) {
+        uint32_t keep = g_flash.tear_keep - 1;
+        g_flash.tear_keep = 0;
+        for (uint32_t i = 0; i < keep && i < len; i++) {
+            g_flash.memory[addr + i] &= buf[i];
+        }
+        return -1;
+    }
+    g_flash.write_count++;
     /* 模拟Flash写入: 只能将1写成0 */
     for (uint32_t i = 0; i < len; i++) {
+        if (g_flash.memory[addr + i] != 0xFF) {
+            g_flash.reprogram++;
+        }
         g_flash.memory[addr + i] &= buf[i];
     }
     return 0;
@@ -77,6 +99,7 @@ static int mem_flash_erase(uint32_t addr, uint32_t len)
 
     for (uint32_t i = block_start; i < block_end; i++) {
         memset(g_flash.memory + i * g_flash.block_size, 0xFF, g_flash.block_size);
+        g_flash.erase_count++;
     }
     return 0;
 }
@@ -93,3 +116,47 @@ int mock_flash_reset(void)
 {
     return mem_flash_reset();
 }
+
+/* 读取并清零read调用计数 */
+uint32_t mock_flash_take_read_count(void)
+{
+    uint32_t count = g_flash.read_count;
+    g_flash.read_count = 0;
+    return count;
+}
+
+/* 读取并清零write调用计数 */
+uint32_t mock_flash_take_write_count(void)
+{
+    uint32_t count = g_flash.write_count;
+    g_flash.write_count = 0;
+    return count;
+}
+
+/* 读取并清零擦除块数 */
+uint32_t mock_flash_take_erase_count(void)
+{
+    uint32_t count = g_flash.erase_count;
+    g_flash.erase_count = 0;
+    return count;
+}
+
+/* 读取并清零重复编程计数 */
+uint32_t mock_flash_take_reprogram_count(void)
+{
+    uint32_t count = g_flash.reprogram;
+    g_flash.reprogram = 0;
+    return count;
+}
+
+/* 第n次write调用返回失败 (n=0取消)，用于测试写入失败路径 */
+void mock_flash_fail_write(uint32_t n)
+{
+    g_flash.fail_after = n;
+}
+
+/* 下一次write只编程前keep字节后返回失败，模拟写入中途掉电 */
+void mock_flash_tear_write(uint32_t keep)
+{
+    g_flash.tear_keep = keep + 1;
+}